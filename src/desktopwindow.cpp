@@ -113,6 +113,8 @@ DesktopWindow::DesktopWindow(int screenNum)
 
         connect(proxyModel_, &Fm::ProxyFolderModel::rowsInserted, this, &DesktopWindow::onRowsInserted);
         connect(proxyModel_, &Fm::ProxyFolderModel::rowsAboutToBeRemoved, this, &DesktopWindow::onRowsAboutToBeRemoved);
+        // FolderModel removes many scattered files at once with a reset
+        connect(proxyModel_, &Fm::ProxyFolderModel::modelReset, this, &DesktopWindow::onModelReset);
         connect(proxyModel_, &Fm::ProxyFolderModel::layoutChanged, this, &DesktopWindow::onLayoutChanged);
         connect(proxyModel_, &Fm::ProxyFolderModel::sortFilterChanged, this, &DesktopWindow::onModelSortFilterChanged);
         connect(proxyModel_, &Fm::ProxyFolderModel::dataChanged, this, &DesktopWindow::onDataChanged);
@@ -1011,6 +1013,17 @@ void DesktopWindow::onRowsAboutToBeRemoved(const QModelIndex& parent, int start,
     Q_UNUSED(parent);
     Q_UNUSED(start);
     Q_UNUSED(end);
+    removeObsoleteItemPositions();
+    listView_->setUpdatesEnabled(false);
+    queueRelayout(100);
+}
+
+void DesktopWindow::onModelReset() {
+    removeObsoleteItemPositions();
+    queueRelayout();
+}
+
+void DesktopWindow::removeObsoleteItemPositions() {
     if (!customItemPos_.empty()) {
         // also delete stored custom item positions for the items currently being removed.
         // Here we can't rely on ProxyFolderModel::fileInfoFromIndex() because, although rows
@@ -1032,8 +1045,6 @@ void DesktopWindow::onRowsAboutToBeRemoved(const QModelIndex& parent, int start,
             saveItemPositions();
         }
     }
-    listView_->setUpdatesEnabled(false);
-    queueRelayout(100);
 }
 
 void DesktopWindow::onLayoutChanged() {
@@ -78,6 +78,8 @@ protected:
 
     void loadItemPositions();
     void saveItemPositions();
+    // forgets the custom positions of the files which no longer exist
+    void removeObsoleteItemPositions();
 
     QImage loadWallpaperFile(QSize requiredSize);
 
@@ -97,6 +99,7 @@ protected Q_SLOTS:
 
     void onRowsAboutToBeRemoved(const QModelIndex& parent, int start, int end);
     void onRowsInserted(const QModelIndex& parent, int start, int end);
+    void onModelReset();
     void onLayoutChanged();
     void onModelSortFilterChanged();
     void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
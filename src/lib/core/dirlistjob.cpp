@@ -2,15 +2,98 @@
 #include <gio/gio.h>
 #include "fileinfo_p.h"
 #include "gioptrs.h"
+#include "jobexecutor.h"
+#include "nativefileinfo.h"
 #include <QDebug>
 
 namespace Fm {
 
 DirListJob::DirListJob(const FilePath& path, Flags _flags, const std::shared_ptr<const HashSet>& cutFilesHashSet):
-    dir_path{path}, flags{_flags}, cutFilesHashSet_{cutFilesHashSet} {
+    dir_path{path},
+    flags{_flags},
+    cutFilesHashSet_{cutFilesHashSet},
+    emit_files_found{false},
+    batchMaxFiles_{2000},
+    batchMaxMsecs_{50} {
+    setExecutionClass(ExecutionClass::INTERACTIVE);
+}
+
+void DirListJob::setIncremental(bool set) {
+    emit_files_found = set;
+}
+
+void DirListJob::setBatchLimits(size_t maxFiles, int maxMsecs) {
+    batchMaxFiles_ = maxFiles > 0 ? maxFiles : 1;
+    batchMaxMsecs_ = maxMsecs;
+}
+
+void DirListJob::addFoundFile(std::shared_ptr<FileInfo> fileInfo, FileInfoList& foundFiles) {
+    if(cutFilesHashSet_
+            && cutFilesHashSet_->count(fileInfo->path().hash()) > 0) {
+        fileInfo->bindCutFiles(cutFilesHashSet_);
+    }
+
+    foundFiles.push_back(std::move(fileInfo));
+
+    // send a batch to the folder as soon as it is big or old enough,
+    // so that the first files can be shown before the listing finishes
+    if(emit_files_found
+       && (foundFiles.size() >= batchMaxFiles_ || batchTimer_.elapsed() >= batchMaxMsecs_)) {
+        flushFoundFiles(foundFiles);
+        batchTimer_.restart();
+    }
+}
+
+bool DirListJob::listNativeDir(FileInfoList& foundFiles) {
+    auto localPath = dir_path.localPath();
+    if(!localPath) {
+        return false;
+    }
+    NativeDirEnumerator enu{localPath.get()};
+    if(!enu.isOpen()) {
+        return false; // let GIO handle and report the error
+    }
+    NativeFileInfoQuery query{enu.fd(), localPath.get()};
+    while(!isCancelled()) {
+        GErrorPtr err;
+        const char* name = enu.next(err);
+        if(!name) {
+            if(err) {
+                ErrorAction act = emitError(err, ErrorSeverity::MILD);
+                /* ErrorAction::RETRY is not supported. */
+                if(act == ErrorAction::ABORT) {
+                    cancel();
+                }
+            }
+            /* otherwise it's EOL */
+            break;
+        }
+        GFileInfoPtr inf = query.query(name, err);
+        if(!inf) {
+            // the file may have been deleted after it was enumerated
+            if(err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_FOUND) {
+                continue;
+            }
+            if(emitError(err, ErrorSeverity::MILD) == ErrorAction::ABORT) {
+                cancel();
+            }
+            continue;
+        }
+        addFoundFile(std::make_shared<FileInfo>(inf, FilePath(), dir_path), foundFiles);
+    }
+    return true;
+}
+
+void DirListJob::flushFoundFiles(FileInfoList& foundFiles) {
+    if(!foundFiles.empty() && !isCancelled()) {
+        Q_EMIT filesFound(foundFiles);
+    }
+    foundFiles.clear();
 }
 
 void DirListJob::exec() {
+    // a remote or MTP folder may block for long, without holding the listings of the local ones
+    JobExecutor::BlockingWait wait{!dir_path.isNative()};
     GErrorPtr err;
     GFileInfoPtr dir_inf;
     GFilePtr dir_gfile = dir_path.gfile();
@@ -56,6 +139,18 @@ _retry:
     }
 
     FileInfoList foundFiles;
+    if(emit_files_found) {
+        foundFiles.reserve(batchMaxFiles_);
+        batchTimer_.start();
+    }
+
+    // for local directories, bypass GIO and read the entries directly,
+    // which avoids content sniffing and most of the per-file GIO overhead
+    if(dir_path.isNative() && !isFileSearch && listNativeDir(foundFiles)) {
+        finishListing(foundFiles);
+        return;
+    }
+
     /* check if FS is R/O and set attr. into inf */
     // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
     err.reset();
@@ -101,17 +196,7 @@ _retry:
                 }
                 fi = fm_file_info_new_from_g_file_data(child, inf, sub);
 #endif
-                auto fileInfo = std::make_shared<FileInfo>(inf, FilePath(), realParentPath);
-                if(emit_files_found) {
-                    // Q_EMIT filesFound();
-                }
-
-                if(cutFilesHashSet_
-                        && cutFilesHashSet_->count(fileInfo->path().hash()) > 0) {
-                    fileInfo->bindCutFiles(cutFilesHashSet_);
-                }
-
-                foundFiles.push_back(std::move(fileInfo));
+                addFoundFile(std::make_shared<FileInfo>(inf, FilePath(), realParentPath), foundFiles);
             }
             else {
                 if(err) {
@@ -135,48 +220,17 @@ _retry:
     }
 
     // qDebug() << "END LISTING:" << dir_path.toString().get();
-    if(!foundFiles.empty()) {
-        std::lock_guard<std::mutex> lock{mutex_};
-        files_.swap(foundFiles);
-    }
+    finishListing(foundFiles);
 }
 
-#if 0
-//FIXME: incremental..
-
-static gboolean emit_found_files(gpointer user_data) {
-    /* this callback is called from the main thread */
-    FmDirListJob* job = FM_DIR_LIST_JOB(user_data);
-    /* g_print("emit_found_files: %d\n", g_slist_length(job->files_to_add)); */
-
-    if(g_source_is_destroyed(g_main_current_source())) {
-        return FALSE;
+void DirListJob::finishListing(FileInfoList& foundFiles) {
+    if(emit_files_found) {
+        flushFoundFiles(foundFiles);
     }
-    g_signal_emit(job, signals[FILES_FOUND], 0, job->files_to_add);
-    g_slist_free_full(job->files_to_add, (GDestroyNotify)fm_file_info_unref);
-    job->files_to_add = nullptr;
-    job->delay_add_files_handler = 0;
-    return FALSE;
-}
-
-static gpointer queue_add_file(FmJob* fmjob, gpointer user_data) {
-    FmDirListJob* job = FM_DIR_LIST_JOB(fmjob);
-    FmFileInfo* file = FM_FILE_INFO(user_data);
-    /* this callback is called from the main thread */
-    /* g_print("queue_add_file: %s\n", fm_file_info_get_disp_name(file)); */
-    job->files_to_add = g_slist_prepend(job->files_to_add, fm_file_info_ref(file));
-    if(job->delay_add_files_handler == 0)
-        job->delay_add_files_handler = g_timeout_add_seconds_full(G_PRIORITY_LOW,
-                                       1, emit_found_files, g_object_ref(job), g_object_unref);
-    return nullptr;
-}
-
-void fm_dir_list_job_add_found_file(FmDirListJob* job, FmFileInfo* file) {
-    fm_file_info_list_push_tail(job->files, file);
-    if(G_UNLIKELY(job->emit_files_found)) {
-        fm_job_call_main_thread(FM_JOB(job), queue_add_file, file);
+    else if(!foundFiles.empty()) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        files_.swap(foundFiles);
     }
 }
-#endif
 
 } // namespace Fm
@@ -3,6 +3,7 @@
 
 #include "../libfmqtglobals.h"
 #include <mutex>
+#include <QElapsedTimer>
 #include "job.h"
 #include "filepath.h"
 #include "gobjectptr.h"
@@ -25,12 +26,17 @@ public:
         return files_;
     }
 
+    // In incremental mode, found files are emitted in batches via filesFound()
+    // while listing is in progress and are not kept in files().
     void setIncremental(bool set);
 
     bool incremental() const {
         return emit_files_found;
     }
 
+    // a batch is emitted when it reaches maxFiles entries or after maxMsecs have elapsed
+    void setBatchLimits(size_t maxFiles, int maxMsecs);
+
     FilePath dirPath() const {
         std::lock_guard<std::mutex> lock{mutex_};
         return dir_path;
@@ -42,12 +48,22 @@ public:
     }
 
 Q_SIGNALS:
+    // this signal should be connected with Qt::BlockingQueuedConnection
     void filesFound(FileInfoList& foundFiles);
 
 protected:
 
     void exec() override;
 
+private:
+    bool listNativeDir(FileInfoList& foundFiles);
+
+    void addFoundFile(std::shared_ptr<FileInfo> fileInfo, FileInfoList& foundFiles);
+
+    void flushFoundFiles(FileInfoList& foundFiles);
+
+    void finishListing(FileInfoList& foundFiles);
+
 private:
     mutable std::mutex mutex_;
     FilePath dir_path;
@@ -56,8 +72,9 @@ private:
     FileInfoList files_;
     const std::shared_ptr<const HashSet> cutFilesHashSet_;
     bool emit_files_found;
-    // guint delay_add_files_handler;
-    // GSList* files_to_add;
+    size_t batchMaxFiles_;
+    int batchMaxMsecs_;
+    QElapsedTimer batchTimer_;
 };
 
 } // namespace Fm
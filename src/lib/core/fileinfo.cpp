@@ -15,6 +15,8 @@ const char defaultGFileInfoQueryAttribs[] = "standard::*,"
                                             "metadata::emblems,"
                                             METADATA_TRUST;
 
+const char metadataPendingAttrib[] = "panda-files::metadata-pending";
+
 FileInfo::FileInfo() {
     // FIXME: initialize numeric data members
 }
@@ -46,7 +48,15 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf, const FilePath
 
     size_ = g_file_info_get_size(inf.get());
 
-    tmp = g_file_info_get_content_type(inf.get());
+    isMimeTypeGuessed_ = false;
+    if(g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+        tmp = g_file_info_get_content_type(inf.get());
+    }
+    else { // only an uncertain guess from the file name may be available (see NativeFileInfoQuery)
+        tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+        isMimeTypeGuessed_ = (tmp != nullptr);
+    }
+    isMetadataPending_ = g_file_info_get_attribute_boolean(inf.get(), metadataPendingAttrib);
     if(tmp) {
         mimeType_ = MimeType::fromName(tmp);
     }
@@ -405,15 +415,26 @@ bool FileInfo::isExecutableType() const {
     return mimeType_->canBeExecutable();
 }
 
+static bool hasTrust(GFileInfo* inf) {
+    /* to avoid GIO assertion warning: */
+    if(g_file_info_get_attribute_type(inf, METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_STRING) {
+        if(const auto data = g_file_info_get_attribute_string(inf, METADATA_TRUST)) {
+            return (strcmp(data, "true") == 0);
+        }
+    }
+    return false;
+}
+
 bool FileInfo::isTrustable() const {
     if(isExecutableType()) {
-        /* to avoid GIO assertion warning: */
-        if(g_file_info_get_attribute_type(inf_.get(), METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_STRING) {
-            if(const auto data = g_file_info_get_attribute_string(inf_.get(), METADATA_TRUST)) {
-                return (strcmp(data, "true") == 0);
-            }
+        if(isMetadataPending_
+           && g_file_info_get_attribute_type(inf_.get(), METADATA_TRUST) == G_FILE_ATTRIBUTE_TYPE_INVALID) {
+            // not read with the other attributes; only this file is asked for
+            GFileInfoPtr meta{g_file_query_info(path().gfile().get(), METADATA_TRUST,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr, nullptr), false};
+            return meta && hasTrust(meta.get());
         }
-        return false;
+        return hasTrust(inf_.get());
     }
     return true;
 }
@@ -429,7 +450,8 @@ void FileInfo::setTrustable(bool trust) const {
     }
     else {
         g_file_info_set_attribute(info.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
-        g_file_info_set_attribute(inf_.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
+        // not unset, so that isTrustable() does not read the metadata of a pending info again
+        g_file_info_set_attribute_string(inf_.get(), METADATA_TRUST, "false");
     }
     g_file_set_attributes_from_info(path().gfile().get(),
                                     info.get(),
@@ -89,6 +89,17 @@ public:
         return mimeType_;
     }
 
+    // true if the mime type was only guessed from the file name and the content should be checked
+    bool isMimeTypeGuessed() const {
+        return isMimeTypeGuessed_;
+    }
+
+    // true if the gvfs metadata was not read with the other attributes, so emblems() is empty
+    // and isTrustable() reads the trust of the file when it is called (see NativeFileInfoQuery)
+    bool isMetadataPending() const {
+        return isMetadataPending_;
+    }
+
     quint64 ctime() const {
         return ctime_;
     }
@@ -262,6 +273,8 @@ private:
     bool isIconChangeable_ : 1; /* TRUE if icon can be changed */
     bool isHiddenChangeable_ : 1; /* TRUE if hidden can be changed */
     bool isReadOnly_ : 1; /* TRUE if host FS is R/O */
+    bool isMimeTypeGuessed_ : 1; /* TRUE if the mime type is not based on the content */
+    bool isMetadataPending_ : 1; /* TRUE if the gvfs metadata has not been read */
 
     std::weak_ptr<const HashSet> cutFilesHashSet_;
     // std::vector<std::tuple<int, void*, void(void*)>> extraData_;
@@ -5,6 +5,9 @@ namespace Fm {
 
     extern const char defaultGFileInfoQueryAttribs[];
 
+    // set on the infos whose gvfs metadata has not been read, see FileInfo::isMetadataPending()
+    extern const char metadataPendingAttrib[];
+
 } // namespace Fm
 
 #endif // FILEINFO_P_H
@@ -1,50 +1,130 @@
 #include "fileinfojob.h"
 #include "fileinfo_p.h"
+#include "nativefileinfo.h"
+#include "jobexecutor.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace Fm {
 
+// batches of native files larger than this are queried by several threads
+static const size_t parallelQueryThreshold = 1024;
+static const int maxQueryThreads = 4;
+
 FileInfoJob::FileInfoJob(FilePathList paths, const std::shared_ptr<const HashSet>& cutFilesHashSet):
     Job(),
     paths_{std::move(paths)},
-    cutFilesHashSet_{cutFilesHashSet} {
+    cutFilesHashSet_{cutFilesHashSet},
+    queryMetadata_{false} {
+    setExecutionClass(ExecutionClass::INTERACTIVE);
 }
 
 void FileInfoJob::exec() {
-    for(const auto& path: paths_) {
-        if(isCancelled()) {
-            break;
-        }
-        currentPath_ = path;
-
-        bool retry;
-        do {
-            retry = false;
-            GErrorPtr err;
-            GFileInfoPtr inf{
-                g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs,
-                                  G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
-                false
-            };
-            if(inf) {
-                auto fileInfoPtr = std::make_shared<FileInfo>(inf, path);
-
-                // FIXME: this is not elegant
-                if(cutFilesHashSet_
-                        && cutFilesHashSet_->count(path.hash())) {
-                    fileInfoPtr->bindCutFiles(cutFilesHashSet_);
+    size_t i = 0;
+    while(i < paths_.size() && !isCancelled()) {
+        // consecutive native files in the same dir are queried in one pass relative to the dir fd,
+        // which is much cheaper than resolving the full path of each file with GIO.
+        const auto& path = paths_[i];
+        const size_t first = i;
+        size_t last = i + 1;
+        std::vector<GFileInfoPtr> infos;
+        if(path.isNative()) {
+            if(auto dirPath = path.parent()) {
+                while(last < paths_.size() && paths_[last].isNative() && paths_[last].parent() == dirPath) {
+                    ++last;
                 }
+                infos.resize(last - i);
+                queryNativeInfos(dirPath, first, last, infos);
+            }
+        }
 
-                results_.push_back(fileInfoPtr);
-                Q_EMIT gotInfo(path, results_.back());
+        for(; i < last && !isCancelled(); ++i) {
+            currentPath_ = paths_[i];
+            if(!infos.empty() && infos[i - first]) {
+                addInfo(paths_[i], infos[i - first]);
             }
             else {
-                auto act = emitError(err);
-                if(act == Job::ErrorAction::RETRY) {
-                    retry = true;
+                // errors and files needing content sniffing are handled by GIO
+                queryInfo(paths_[i]);
+            }
+        }
+    }
+}
+
+void FileInfoJob::queryNativeInfos(const FilePath& dirPath, size_t first, size_t last, std::vector<GFileInfoPtr>& infos) {
+    auto localPath = dirPath.localPath();
+    int dirFd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirFd < 0) {
+        return; // GIO will report the error
+    }
+
+    NativeFileInfoQuery query{dirFd, localPath.get()};
+    size_t count = last - first;
+    auto queryRange = [&](size_t begin, size_t end) {
+        for(size_t k = begin; k < end && !isCancelled(); ++k) {
+            GErrorPtr err;
+            auto name = paths_[first + k].baseName();
+            auto inf = query.query(name.get(), err);
+            // like GIO, sniff the content if the type guessed from the name is uncertain
+            if(inf && g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+                if(queryMetadata_ && g_file_info_get_attribute_boolean(inf.get(), metadataPendingAttrib)) {
+                    query.queryMetadata(name.get(), inf.get(), cancellable().get());
                 }
+                infos[k] = std::move(inf);
             }
-        } while(retry && !isCancelled());
+        }
+    };
+
+    int nThreads = std::min(maxQueryThreads, std::max(QThread::idealThreadCount(), 1));
+    if(count >= parallelQueryThreshold && nThreads > 1) {
+        // every part fills its own range of infos, in the threads of the job's own pool
+        size_t chunk = (count + nThreads - 1) / nThreads;
+        JobExecutor::globalInstance()->runInParallel(executionClass(), nThreads, [&](int i) {
+            queryRange(std::min(i * chunk, count), std::min((i + 1) * chunk, count));
+        });
     }
+    else {
+        queryRange(0, count);
+    }
+    close(dirFd);
+}
+
+void FileInfoJob::queryInfo(const FilePath& path) {
+    // see DirListJob::exec()
+    JobExecutor::BlockingWait wait{!path.isNative()};
+    bool retry;
+    do {
+        retry = false;
+        GErrorPtr err;
+        GFileInfoPtr inf{
+            g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs,
+                              G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
+            false
+        };
+        if(inf) {
+            addInfo(path, inf);
+        }
+        else {
+            auto act = emitError(err);
+            if(act == Job::ErrorAction::RETRY) {
+                retry = true;
+            }
+        }
+    } while(retry && !isCancelled());
+}
+
+void FileInfoJob::addInfo(const FilePath& path, const GFileInfoPtr& inf) {
+    auto fileInfoPtr = std::make_shared<FileInfo>(inf, path);
+
+    // FIXME: this is not elegant
+    if(cutFilesHashSet_
+            && cutFilesHashSet_->count(path.hash())) {
+        fileInfoPtr->bindCutFiles(cutFilesHashSet_);
+    }
+
+    results_.push_back(fileInfoPtr);
+    Q_EMIT gotInfo(path, results_.back());
 }
 
 } // namespace Fm
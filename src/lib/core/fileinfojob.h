@@ -5,6 +5,8 @@
 #include "job.h"
 #include "filepath.h"
 #include "fileinfo.h"
+#include "gioptrs.h"
+#include <vector>
 
 namespace Fm {
 
@@ -27,17 +29,31 @@ public:
         return currentPath_;
     }
 
+    // reads the gvfs metadata of the native files too, which is otherwise left for later
+    // (see FileInfo::isMetadataPending())
+    void setQueryMetadata(bool queryMetadata) {
+        queryMetadata_ = queryMetadata;
+    }
+
 Q_SIGNALS:
     void gotInfo(const FilePath& path, std::shared_ptr<const FileInfo>& info);
 
 protected:
     void exec() override;
 
+private:
+    void queryNativeInfos(const FilePath& dirPath, size_t first, size_t last, std::vector<GFileInfoPtr>& infos);
+
+    void queryInfo(const FilePath& path);
+
+    void addInfo(const FilePath& path, const GFileInfoPtr& inf);
+
 private:
     FilePathList paths_;
     FileInfoList results_;
     const std::shared_ptr<const HashSet> cutFilesHashSet_;
     FilePath currentPath_;
+    bool queryMetadata_;
 };
 
 } // namespace Fm
@@ -1,4 +1,5 @@
 #include "fileoperationjob.h"
+#include "jobexecutor.h"
 
 namespace Fm {
 
@@ -10,7 +11,9 @@ FileOperationJob::FileOperationJob():
     finishedSize_{0},
     finishedCount_{0},
     currentFileSize_{0},
-    currentFileFinished_{0} {
+    currentFileFinished_{0},
+    inFlightFinishedTotal_{0} {
+    setExecutionClass(ExecutionClass::BULK_IO);
 }
 
 bool FileOperationJob::totalAmount(uint64_t& fileSize, uint64_t& fileCount) const {
@@ -36,7 +39,7 @@ double FileOperationJob::progress() const {
     std::lock_guard<std::mutex> lock{mutex_};
     double finishedRatio;
     if(calcProgressUsingSize_) {
-        finishedRatio = totalSize_ > 0 ? double(finishedSize_ + currentFileFinished_) / totalSize_ : 0.0;
+        finishedRatio = totalSize_ > 0 ? double(finishedSize_ + inFlightFinishedTotal_) / totalSize_ : 0.0;
     }
     else {
         finishedRatio = totalCount_ > 0 ? double(finishedCount_) / totalCount_ : 0.0;
@@ -49,6 +52,8 @@ double FileOperationJob::progress() const {
 }
 
 FileOperationJob::FileExistsAction FileOperationJob::askRename(const FileInfo &src, const FileInfo &dest, FilePath &newDest) {
+    JobExecutor::BlockingWait wait; // see Job::emitError()
+    std::lock_guard<std::mutex> lock{promptMutex_};
     FileExistsAction action = SKIP;
     Q_EMIT fileExists(src, dest, action, newDest);
     return action;
@@ -97,6 +102,24 @@ void FileOperationJob::setCurrentFileProgress(uint64_t totalSize, uint64_t finis
     std::lock_guard<std::mutex> lock{mutex_};
     currentFileSize_ = totalSize;
     currentFileFinished_ = finishedSize;
+
+    auto threadId = std::this_thread::get_id();
+    auto it = inFlightFinished_.find(threadId);
+    if(it != inFlightFinished_.end()) {
+        inFlightFinishedTotal_ -= it->second;
+        if(totalSize == 0 && finishedSize == 0) {
+            inFlightFinished_.erase(it);
+        }
+        else {
+            it->second = finishedSize;
+        }
+    }
+    else if(totalSize != 0 || finishedSize != 0) {
+        inFlightFinished_.emplace(threadId, finishedSize);
+    }
+    if(totalSize != 0 || finishedSize != 0) {
+        inFlightFinishedTotal_ += finishedSize;
+    }
 }
 
 } // namespace Fm
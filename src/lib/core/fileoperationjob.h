@@ -6,6 +6,8 @@
 #include <string>
 #include <mutex>
 #include <cstdint>
+#include <thread>
+#include <unordered_map>
 #include "fileinfo.h"
 #include "filepath.h"
 
@@ -57,6 +59,8 @@ Q_SIGNALS:
 
 protected:
 
+    // NOTE: askRename() can be called from several worker threads of the same job.
+    // The prompts are serialized so only one of them is shown at a time.
     FileExistsAction askRename(const FileInfo& src, const FileInfo& dest, FilePath& newDest);
 
     void setTotalAmount(std::uint64_t fileSize, std::uint64_t fileCount);
@@ -67,6 +71,8 @@ protected:
 
     void setCurrentFile(const FilePath &path);
 
+    // the progress is recorded per calling thread so several files can be copied in parallel.
+    // call setCurrentFileProgress(0, 0) from the same thread once the file is done.
     void setCurrentFileProgress(uint64_t totalSize, uint64_t finishedSize);
 
     void setCalcProgressUsingSize(bool value) {
@@ -88,6 +94,9 @@ private:
     FilePath currentFile_;
     std::uint64_t currentFileSize_;
     std::uint64_t currentFileFinished_;
+    // finished bytes of the files which are still in progress, per thread
+    std::unordered_map<std::thread::id, std::uint64_t> inFlightFinished_;
+    std::uint64_t inFlightFinishedTotal_;
     mutable std::mutex mutex_;
 };
 
@@ -1,13 +1,43 @@
 #include "filetransferjob.h"
 #include "totalsizejob.h"
 #include "fileinfo_p.h"
+#include "nativefilecopy.h"
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 namespace Fm {
 
+namespace {
+
+// copies a file queued by FileTransferJob::queueRegularFileCopy() in a worker thread
+class CopyTask: public QRunnable {
+public:
+    explicit CopyTask(std::function<void ()> func): func_{std::move(func)} {
+    }
+
+    void run() override {
+        func_();
+    }
+
+private:
+    std::function<void ()> func_;
+};
+
+} // namespace
+
+int FileTransferJob::defaultWorkerCount_ = 1;
+
 FileTransferJob::FileTransferJob(FilePathList srcPaths, Mode mode):
     FileOperationJob{},
     srcPaths_{std::move(srcPaths)},
-    mode_{mode} {
+    mode_{mode},
+    workerCount_{defaultWorkerCount_},
+    progressByAllocatedSize_{false},
+    queuedCopies_{0},
+    maxQueuedCopies_{0} {
 }
 
 FileTransferJob::FileTransferJob(FilePathList srcPaths, FilePathList destPaths, Mode mode):
@@ -69,8 +99,89 @@ void FileTransferJob::setDestDirPath(const FilePath& destDirPath) {
     }
 }
 
-void FileTransferJob::gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, FileTransferJob* _this) {
-    _this->setCurrentFileProgress(total_num_bytes, current_num_bytes);
+int FileTransferJob::workerCountForPath(const FilePath& path) {
+    if(!path.isNative()) {
+        // remote filesystems: several requests in flight hide the latency of each one
+        return 4;
+    }
+    auto localPath = path.localPath();
+    struct stat st;
+    if(stat(localPath.get(), &st) != 0) {
+        // the path may not exist yet
+        auto parent = path.parent();
+        return parent ? workerCountForPath(parent) : 4;
+    }
+    // sysfs tells whether the block device is rotational.
+    // for a partition, the attribute is in the directory of its disk.
+    const char* const attrs[] = {"queue/rotational", "../queue/rotational"};
+    for(auto attr: attrs) {
+        CStrPtr fileName{g_strdup_printf("/sys/dev/block/%u:%u/%s", major(st.st_dev), minor(st.st_dev), attr)};
+        char* contents = nullptr;
+        if(g_file_get_contents(fileName.get(), &contents, nullptr, nullptr)) {
+            bool rotational = (contents[0] == '1');
+            g_free(contents);
+            // seeking between files is expensive on hard disks
+            return rotational ? 2 : 8;
+        }
+    }
+    return 4; // not a block device (tmpfs, fuse, nfs, ...)
+}
+
+void FileTransferJob::startCopyWorkers(int count) {
+    copyPool_.reset(new QThreadPool{});
+    copyPool_->setMaxThreadCount(count);
+    queuedCopies_ = 0;
+    maxQueuedCopies_ = count * 4;
+}
+
+void FileTransferJob::queueRegularFileCopy(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destPath) {
+    {
+        // don't let the walker get too far ahead of the workers
+        std::unique_lock<std::mutex> lock{copyQueueMutex_};
+        while(queuedCopies_ >= maxQueuedCopies_ && !isCancelled()) {
+            copyQueueCond_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if(isCancelled()) {
+            return;
+        }
+        ++queuedCopies_;
+    }
+
+    copyPool_->start(new CopyTask{[this, srcPath, srcInfo, destPath]() {
+        if(!isCancelled()) {
+            setCurrentFile(srcPath);
+            auto size = progressAmount(srcInfo);
+            FilePath dest = destPath;
+            if(copyRegularFile(srcPath, srcInfo, dest)) {
+                addFinishedAmount(size, 1);
+            }
+            setCurrentFileProgress(0, 0);
+        }
+        std::lock_guard<std::mutex> lock{copyQueueMutex_};
+        --queuedCopies_;
+        copyQueueCond_.notify_one();
+    }});
+}
+
+void FileTransferJob::waitForCopyWorkers() {
+    copyPool_->waitForDone();
+    copyPool_.reset();
+}
+
+std::uint64_t FileTransferJob::progressAmount(const GFileInfoPtr& srcInfo) const {
+    if(progressByAllocatedSize_) {
+        return g_file_info_get_attribute_uint64(srcInfo.get(), G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
+    }
+    return g_file_info_get_size(srcInfo.get());
+}
+
+void FileTransferJob::gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, CopyProgress* progress) {
+    // the copy reports bytes of the file, which may differ from the amount of work counted for it
+    std::uint64_t finished = 0;
+    if(total_num_bytes > 0) {
+        finished = std::uint64_t(double(current_num_bytes) / total_num_bytes * progress->amount);
+    }
+    progress->job->setCurrentFileProgress(progress->amount, finished);
 }
 
 bool FileTransferJob::moveFileSameFs(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath) {
@@ -108,12 +219,29 @@ bool FileTransferJob::copyRegularFile(const FilePath& srcPath, const GFileInfoPt
         err.reset();
 
         // reset progress of the current file (only for copy)
-        auto size = g_file_info_get_size(srcInfo.get());
+        auto size = progressAmount(srcInfo);
         setCurrentFileProgress(size, 0);
+        CopyProgress progress{this, size};
 
         // do the file operation
-        if(!g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(),
-                       (GFileProgressCallback)&gfileCopyProgressCallback, this, &err)) {
+        bool copied = false;
+        bool useGio = true;
+        if(srcPath.isNative() && destPath.isNative()
+                && g_file_info_get_file_type(srcInfo.get()) == G_FILE_TYPE_REGULAR) {
+            // let the kernel copy the data if possible (reflink, copy_file_range, ...)
+            NativeFileCopy nativeCopy{srcPath.localPath().get(), destPath.localPath().get()};
+            copied = nativeCopy.run(GFileCopyFlags(flags), cancellable().get(),
+                                    (GFileProgressCallback)&gfileCopyProgressCallback, &progress, err);
+            useGio = (!copied && err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_SUPPORTED);
+            if(useGio) {
+                err.reset();
+            }
+        }
+        if(useGio) {
+            copied = g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(),
+                                 (GFileProgressCallback)&gfileCopyProgressCallback, &progress, &err);
+        }
+        if(!copied) {
             retry = handleError(err, srcPath, srcInfo, destPath, flags);
         }
         else {
@@ -440,7 +568,7 @@ bool FileTransferJob::moveFile(const FilePath &srcPath, const GFileInfoPtr &srcI
         // increase current progress
         // FIXME: it's not appropriate to calculate the progress of move operations using file size
         // since the time required to move a file is not related to it's file size.
-        auto size = g_file_info_get_size(srcInfo.get());
+        auto size = progressAmount(srcInfo);
         addFinishedAmount(size, 1);
     }
     else {
@@ -452,9 +580,16 @@ bool FileTransferJob::moveFile(const FilePath &srcPath, const GFileInfoPtr &srcI
 }
 
 bool FileTransferJob::copyFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destDirPath, const char* destFileName, bool skip) {
+    if(copyPool_ && !skip && g_file_info_get_file_type(srcInfo.get()) == G_FILE_TYPE_REGULAR) {
+        // copied by a worker thread, which also updates the progress.
+        // NOTE: errors are reported by the worker, so the file is counted as copied here.
+        queueRegularFileCopy(srcPath, srcInfo, destDirPath.child(destFileName));
+        return true;
+    }
+
     setCurrentFile(srcPath);
 
-    auto size = g_file_info_get_size(srcInfo.get());
+    auto size = progressAmount(srcInfo);
     bool success = false;
     setCurrentFileProgress(size, 0);
 
@@ -641,8 +776,18 @@ void FileTransferJob::exec() {
         return;
     }
 
+    // native files are copied without filling the holes of sparse files, so the time needed
+    // depends on the allocated size rather than on the file size.
+    auto isNative = [](const FilePath& path) {
+        return path.isNative();
+    };
+    progressByAllocatedSize_ = (mode_ != Mode::LINK
+                                && std::all_of(srcPaths_.cbegin(), srcPaths_.cend(), isNative)
+                                && std::all_of(destPaths_.cbegin(), destPaths_.cend(), isNative));
+
     // ready to start
-    setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount());
+    setTotalAmount(progressByAllocatedSize_ ? totalSizeJob.totalOnDiskSize() : totalSizeJob.totalSize(),
+                   totalSizeJob.fileCount());
     Q_EMIT preparedToRun();
 
     if(srcPaths_.size() != destPaths_.size()) {
@@ -650,6 +795,17 @@ void FileTransferJob::exec() {
         return;
     }
 
+    // regular files can be copied in parallel while the source tree is walked.
+    // NOTE: this is not done for cross-filesystem moves, which delete the source
+    // directories after their content is copied.
+    int workers = workerCount_;
+    if(workers == 0 && !srcPaths_.empty()) {
+        workers = std::min(workerCountForPath(srcPaths_.front()), workerCountForPath(destPaths_.front()));
+    }
+    if(mode_ == Mode::COPY && workers > 1) {
+        startCopyWorkers(workers);
+    }
+
     // copy the files
     for(size_t i = 0; i < srcPaths_.size(); ++i) {
         if(isCancelled()) {
@@ -660,6 +816,10 @@ void FileTransferJob::exec() {
         auto destDirPath = destPath.parent();
         processPath(srcPath, destDirPath, destPath.baseName().get());
     }
+
+    if(copyPool_) {
+        waitForCopyWorkers();
+    }
 }
 
 
@@ -4,6 +4,10 @@
 #include "../libfmqtglobals.h"
 #include "fileoperationjob.h"
 #include "gioptrs.h"
+#include <QThreadPool>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 namespace Fm {
 
@@ -25,6 +29,29 @@ public:
     void setDestPaths(FilePathList destPaths);
     void setDestDirPath(const FilePath &destDirPath);
 
+    // Number of files copied in parallel by worker threads while the source tree is walked.
+    // 1 copies the files one by one, 0 chooses a count suitable for the source and destination
+    // filesystems (see workerCountForPath()). Only used in Mode::COPY.
+    void setWorkerCount(int count) {
+        workerCount_ = count;
+    }
+
+    int workerCount() const {
+        return workerCount_;
+    }
+
+    // the worker count of newly created jobs
+    static void setDefaultWorkerCount(int count) {
+        defaultWorkerCount_ = count;
+    }
+
+    static int defaultWorkerCount() {
+        return defaultWorkerCount_;
+    }
+
+    // a worker count suitable for the filesystem of the path: lower for rotational disks
+    static int workerCountForPath(const FilePath& path);
+
 protected:
     void exec() override;
 
@@ -44,12 +71,35 @@ private:
 
     bool handleError(GErrorPtr& err, const FilePath &srcPath, const GFileInfoPtr &srcInfo, FilePath &destPath, int& flags);
 
-    static void gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, FileTransferJob* _this);
+    // the amount of work of a file used for the progress: its size or its allocated size
+    std::uint64_t progressAmount(const GFileInfoPtr& srcInfo) const;
+
+    struct CopyProgress {
+        FileTransferJob* job;
+        std::uint64_t amount; // see progressAmount()
+    };
+
+    static void gfileCopyProgressCallback(goffset current_num_bytes, goffset total_num_bytes, CopyProgress* progress);
+
+    void startCopyWorkers(int count);
+    void queueRegularFileCopy(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destPath);
+    void waitForCopyWorkers();
 
 private:
     FilePathList srcPaths_;
     FilePathList destPaths_;
     Mode mode_;
+    int workerCount_;
+    bool progressByAllocatedSize_;
+
+    // parallel copy: the files queued by the walker are copied in this pool
+    std::unique_ptr<QThreadPool> copyPool_;
+    std::mutex copyQueueMutex_;
+    std::condition_variable copyQueueCond_;
+    size_t queuedCopies_;
+    size_t maxQueuedCopies_;
+
+    static int defaultWorkerCount_;
 };
 
 
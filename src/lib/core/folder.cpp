@@ -39,6 +39,10 @@ QString Folder::lastCutFilesDirPath_;
 std::shared_ptr<const HashSet> Folder::cutFilesHashSet_;
 std::mutex Folder::mutex_;
 
+// bounds of the update window used when a folder changes continuously
+static const int minUpdateDelay = 250;
+static const int maxUpdateDelay = 1000;
+
 Folder::Folder():
     dirlist_job{nullptr},
     fsInfoJob_{nullptr},
@@ -48,7 +52,11 @@ Folder::Folder():
     has_idle_update_handler{false},
     pending_change_notify{false},
     filesystem_info_pending{false},
-    wants_incremental{false},
+    updateDelay_{0},
+    changeRate_{0.0},
+    pendingEventCount_{0},
+    mimeRefineJob_{nullptr},
+    wants_incremental{true},
     stop_emission{false}, /* don't set it 1 bit to not lock other bits */
     /* filesystem info - set in query thread, read in main */
     fs_total_size{0},
@@ -83,6 +91,8 @@ Folder::~Folder() {
         fsInfoJob_->cancel();
     }
 
+    cancelMimeTypeRefinement();
+
     // We store a weak_ptr instead of shared_ptr in the hash table, so the hash table
     // does not own a reference to the folder. When the last reference to Folder is
     // freed, we need to remove its hash table entry.
@@ -265,7 +275,7 @@ void Folder::onFileInfoFinished() {
     // process the changes accumulated during this info job
     if(filesystem_info_pending // means a pending change; see "onFileSystemInfoFinished()"
        || !paths_to_update.empty() || !paths_to_add.empty() || !paths_to_del.empty()) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        scheduleUpdate();
     }
     // there's no pending change at the moment; let the next one be processed
     else {
@@ -284,14 +294,14 @@ void Folder::processPendingChanges() {
         return;
     }
 
+    updateChangeRate();
+
     FileInfoJob* info_job = nullptr;
     if(!paths_to_update.empty() || !paths_to_add.empty()) {
         FilePathList paths;
-        paths.insert(paths.end(), paths_to_add.cbegin(), paths_to_add.cend());
-        paths.insert(paths.end(), paths_to_update.cbegin(), paths_to_update.cend());
+        paths_to_add.takeAll(paths);
+        paths_to_update.takeAll(paths);
         info_job = new FileInfoJob{paths, hasCutFiles() ? cutFilesHashSet_ : nullptr};
-        paths_to_update.clear();
-        paths_to_add.clear();
     }
     else {
         // let the next pending changes be processed; see "onFileInfoFinished()"
@@ -315,20 +325,15 @@ void Folder::processPendingChanges() {
 
     // process deletion
     FileInfoList deleted_files;
-    auto path_it = paths_to_del.begin();
-    while(path_it != paths_to_del.end()) {
-        const auto& path = *path_it;
-        auto name = path.baseName();
-        auto it = files_.find(name.get());
+    paths_to_del.removeIf([&](const std::string& name, const FilePath& /*path*/) {
+        auto it = files_.find(name);
         if(it != files_.end()) {
             deleted_files.push_back(it->second);
             files_.erase(it);
-            path_it = paths_to_del.erase(path_it);
-        }
-        else {
-            ++path_it;
+            return true;
         }
-    }
+        return false;
+    });
     if(!deleted_files.empty()) {
         Q_EMIT filesRemoved(deleted_files);
         Q_EMIT contentChanged();
@@ -350,12 +355,64 @@ void Folder::processPendingChanges() {
 /* should be called only with G_LOCK(lists) on! */
 void Folder::queueUpdate() {
     // qDebug() << "queue_update:" << !has_idle_handler << paths_to_add.size() << paths_to_update.size() << paths_to_del.size();
+    ++pendingEventCount_;
     if(!has_idle_update_handler) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        scheduleUpdate();
         has_idle_update_handler = true;
     }
 }
 
+// Processes the pending changes at once if the last update is older than the largest window.
+// Otherwise, the folder is changing continuously and the window is doubled, so that
+// a stream of changes results in fewer but larger updates.
+void Folder::scheduleUpdate() {
+    int delay = 0;
+    int oldUpdateDelay = updateDelay_;
+    if(lastUpdateTimer_.isValid() && lastUpdateTimer_.elapsed() < maxUpdateDelay) {
+        updateDelay_ = qBound(minUpdateDelay, updateDelay_ * 2, maxUpdateDelay);
+        delay = qMax(0, updateDelay_ - int(lastUpdateTimer_.elapsed()));
+    }
+    else {
+        updateDelay_ = 0;
+    }
+    QTimer::singleShot(delay, this, &Folder::processPendingChanges);
+    if(updateDelay_ != oldUpdateDelay) {
+        Q_EMIT updateRateChanged();
+    }
+}
+
+void Folder::updateChangeRate() {
+    if(lastUpdateTimer_.isValid()) {
+        qint64 elapsed = qMax(lastUpdateTimer_.elapsed(), qint64(1));
+        double rate = pendingEventCount_ * 1000.0 / elapsed;
+        // smooth the rate of a continuously changing folder
+        changeRate_ = elapsed < maxUpdateDelay ? (changeRate_ + rate) / 2 : rate;
+    }
+    lastUpdateTimer_.start();
+    pendingEventCount_ = 0;
+    if(updateDelay_ > 0) {
+        Q_EMIT updateRateChanged();
+        // find out when the folder becomes quiet again
+        QTimer::singleShot(maxUpdateDelay + 1, this, &Folder::onUpdateQuietCheck);
+    }
+}
+
+void Folder::onUpdateQuietCheck() {
+    if(updateDelay_ > 0 && !has_idle_update_handler && lastUpdateTimer_.elapsed() >= maxUpdateDelay) {
+        updateDelay_ = 0;
+        changeRate_ = 0.0;
+        Q_EMIT updateRateChanged();
+    }
+}
+
+int Folder::updateDelay() const {
+    return updateDelay_;
+}
+
+double Folder::changeRate() const {
+    return updateDelay_ > 0 ? changeRate_ : 0.0;
+}
+
 
 /* NOTE: When queuing files for addition/update/deletion in the following functions,
    the currently detected files (namely, "files_") should not be taken into account
@@ -365,18 +422,14 @@ void Folder::queueUpdate() {
 bool Folder::eventFileAdded(const FilePath &path) {
     bool added = true;
     // G_LOCK(lists);
-    if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) != paths_to_del.cend()) {
+    const std::string name = path.baseName().get();
+    if(paths_to_del.remove(name)) {
         // if the file was going to be deleted, its addition means an update,
         // so remove it from the deletion queue and add it to the update queue
-        paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
-            paths_to_update.push_back(path);
-        }
+        paths_to_update.insert(name, path);
     }
-    else if(std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_add.push_back(path);
-    }
-    else { // file already queued for adding, don't duplicate
+    else if(!paths_to_add.insert(name, path)) {
+        // file already queued for adding, don't duplicate
         added = false;
     }
 
@@ -390,9 +443,8 @@ bool Folder::eventFileAdded(const FilePath &path) {
 bool Folder::eventFileChanged(const FilePath &path) {
     bool added;
     // G_LOCK(lists);
-    if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()
-       && std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_update.push_back(path);
+    const std::string name = path.baseName().get();
+    if(!paths_to_add.contains(name) && paths_to_update.insert(name, path)) {
         added = true;
         queueUpdate();
     }
@@ -410,10 +462,10 @@ void Folder::eventFileDeleted(const FilePath& path) {
     /* WARNING: If the file is in the addition queue, we shouldn not remove it from that queue
        and ignore its deletion because it may have been added by the directory list job, in
        which case, ignoring an addition-deletion sequence would result in a nonexistent file. */
-    if(std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
-        paths_to_del.push_back(path);
+    const std::string name = path.baseName().get();
+    if(paths_to_del.insert(name, path)) {
         // the update queue can be cancelled for a file that is going to be deleted
-        paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path), paths_to_update.cend());
+        paths_to_update.remove(name);
     }
     else {
         deleted = false;
@@ -447,8 +499,7 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
     case G_FILE_MONITOR_EVENT_CHANGED: {
         std::lock_guard<std::mutex> lock{mutex_};
         pending_change_notify = true;
-        if(std::find(paths_to_update.cbegin(), paths_to_update.cend(), dirPath_) != paths_to_update.cend()) {
-            paths_to_update.push_back(dirPath_);
+        if(paths_to_update.insert(std::string{}, dirPath_)) {
             queueUpdate();
         }
         /* g_debug("folder is changed"); */
@@ -547,25 +598,11 @@ void Folder::updateCutFiles() {
     }
 }
 
-void Folder::onDirListFinished() {
-    DirListJob* job = static_cast<DirListJob*>(sender());
-    if(job->isCancelled()) { // this is a cancelled job, ignore!
-        if(job == dirlist_job) {
-            dirlist_job = nullptr;
-            Q_EMIT finishLoading(); // this was the last job until now
-        }
-        return;
-    }
-    dirInfo_ = job->dirInfo();
-
-    FileInfoList files_to_add;
-    std::vector<FileInfoPair> files_to_update;
-    const auto& infos = job->files();
-
+void Folder::addDirListFiles(const FileInfoList& infos, FileInfoList& files_to_add, std::vector<FileInfoPair>& files_to_update) {
     // with "search://", there is no update for infos and all of them should be added
     if(strcmp(dirPath_.uriScheme().get(), "search") == 0) {
-        files_to_add = infos;
-        for(auto& file: files_to_add) {
+        files_to_add.insert(files_to_add.end(), infos.cbegin(), infos.cend());
+        for(auto& file: infos) {
             files_[file->path().baseName().get()] = file;
         }
     }
@@ -583,6 +620,179 @@ void Folder::onDirListFinished() {
             files_[info->path().baseName().get()] = info;
         }
     }
+}
+
+// Files listed by NativeFileInfoQuery may only have a mime type guessed from their names.
+// Their content is checked later in small batches by FileInfoJob, which uses GIO content sniffing.
+void Folder::queueMimeTypeRefinement(const FileInfoList& files) {
+    if(!dirPath_.isNative()) {
+        return;
+    }
+    bool queued = false;
+    for(auto& file: files) {
+        if(file->isMimeTypeGuessed()) {
+            mimeRefineQueue_.push_back(file);
+            queued = true;
+        }
+    }
+    if(queued && !mimeRefineJob_) {
+        QTimer::singleShot(0, this, &Folder::processMimeTypeRefinement);
+    }
+}
+
+void Folder::refineFileInfo(const std::shared_ptr<const FileInfo>& file) {
+    if((!file->isMimeTypeGuessed() && !file->isMetadataPending()) || !dirPath_.isNative()) {
+        return;
+    }
+    // a view may still show an info which has been refined or updated since
+    auto it = files_.find(file->name());
+    if(it == files_.end() || it->second != file) {
+        return;
+    }
+    auto confirmedIt = confirmedFiles_.find(file->name());
+    if(confirmedIt != confirmedFiles_.end() && confirmedIt->second == file) {
+        return; // already refined
+    }
+    if(mimeRefineStartedNames_.count(file->name()) > 0
+       || !mimeRefineUrgentNames_.insert(file->name()).second) {
+        return; // already being refined or queued
+    }
+    mimeRefineUrgentQueue_.push_back(file);
+    if(!mimeRefineJob_ && mimeRefineUrgentQueue_.size() == 1) {
+        QTimer::singleShot(0, this, &Folder::processMimeTypeRefinement);
+    }
+}
+
+void Folder::processMimeTypeRefinement() {
+    if(mimeRefineJob_) {
+        return; // the next batch is started when the current one is finished
+    }
+    const size_t maxBatchSize = 256;
+    FilePathList paths;
+    auto takeFrom = [&](std::deque<std::shared_ptr<const FileInfo>>& queue) {
+        while(!queue.empty() && paths.size() < maxBatchSize) {
+            auto file = std::move(queue.front());
+            queue.pop_front();
+            // skip files that have been refined, updated or removed in the meantime
+            auto it = files_.find(file->path().baseName().get());
+            if(it == files_.end() || it->second != file
+               || !mimeRefineStartedNames_.insert(file->name()).second) {
+                continue;
+            }
+            paths.push_back(file->path());
+        }
+    };
+    takeFrom(mimeRefineUrgentQueue_);
+    mimeRefineUrgentNames_.clear();
+    for(auto& file: mimeRefineUrgentQueue_) {
+        mimeRefineUrgentNames_.insert(file->name());
+    }
+    takeFrom(mimeRefineQueue_);
+    if(paths.empty()) {
+        return;
+    }
+
+    mimeRefineJob_ = new FileInfoJob{std::move(paths), hasCutFiles() ? cutFilesHashSet_ : nullptr};
+    mimeRefineJob_->setAutoDelete(true);
+    mimeRefineJob_->setExecutionClass(Job::ExecutionClass::BACKGROUND);
+    mimeRefineJob_->setQueryMetadata(true);
+    connect(mimeRefineJob_, &FileInfoJob::finished, this, &Folder::onMimeTypeRefineFinished, Qt::BlockingQueuedConnection);
+    mimeRefineJob_->runAsync(QThread::LowPriority);
+}
+
+void Folder::onMimeTypeRefineFinished() {
+    FileInfoJob* job = static_cast<FileInfoJob*>(sender());
+    if(job != mimeRefineJob_) { // a cancelled job
+        return;
+    }
+    mimeRefineJob_ = nullptr;
+    if(job->isCancelled()) {
+        return;
+    }
+
+    // the files which could not be queried are not refined, but may be again once updated
+    for(const auto& path: job->paths()) {
+        mimeRefineStartedNames_.erase(path.baseName().get());
+    }
+    std::vector<FileInfoPair> files_to_update;
+    for(const auto& info: job->files()) {
+        auto it = files_.find(info->path().baseName().get());
+        // only replace the guessed or pending info; a newer update from the file monitor is kept
+        if(it != files_.end() && (it->second->isMimeTypeGuessed() || it->second->isMetadataPending())) {
+            // the trust of a desktop entry is shown by the views, see FolderItemDelegate
+            if(it->second->mimeType() != info->mimeType()
+               || g_file_info_has_namespace(info->gFileInfo().get(), "metadata")
+               || (it->second->isMetadataPending() && info->isDesktopEntry())) {
+                files_to_update.push_back(std::make_pair(it->second, info));
+                it->second = info;
+            }
+            else {
+                // the guess was right; the info is kept, so the views are not updated for nothing
+                confirmedFiles_[it->first] = it->second;
+            }
+        }
+    }
+    if(!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+
+    if(!mimeRefineUrgentQueue_.empty() || !mimeRefineQueue_.empty()) {
+        QTimer::singleShot(0, this, &Folder::processMimeTypeRefinement);
+    }
+}
+
+void Folder::cancelMimeTypeRefinement() {
+    if(mimeRefineJob_) {
+        mimeRefineJob_->cancel();
+        mimeRefineJob_ = nullptr;
+    }
+    mimeRefineQueue_.clear();
+    mimeRefineUrgentQueue_.clear();
+    mimeRefineUrgentNames_.clear();
+    mimeRefineStartedNames_.clear();
+    confirmedFiles_.clear();
+}
+
+// called for each batch of files found by an incremental dir list job
+void Folder::onDirListFilesFound(FileInfoList& foundFiles) {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job != dirlist_job || job->isCancelled()) { // an obsolete job, ignore!
+        return;
+    }
+    // we may want info while folder is still loading
+    if(!dirInfo_) {
+        dirInfo_ = job->dirInfo();
+    }
+
+    FileInfoList files_to_add;
+    std::vector<FileInfoPair> files_to_update;
+    addDirListFiles(foundFiles, files_to_add, files_to_update);
+    queueMimeTypeRefinement(foundFiles);
+
+    if(!files_to_add.empty()) {
+        Q_EMIT filesAdded(files_to_add);
+    }
+    if(!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+}
+
+void Folder::onDirListFinished() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    if(job->isCancelled()) { // this is a cancelled job, ignore!
+        if(job == dirlist_job) {
+            dirlist_job = nullptr;
+            Q_EMIT finishLoading(); // this was the last job until now
+        }
+        return;
+    }
+    dirInfo_ = job->dirInfo();
+
+    // in incremental mode, all files have already been added by onDirListFilesFound()
+    FileInfoList files_to_add;
+    std::vector<FileInfoPair> files_to_update;
+    addDirListFiles(job->files(), files_to_add, files_to_update);
+    queueMimeTypeRefinement(job->files());
 
     if(!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
@@ -653,21 +863,6 @@ void Folder::onDirListFinished() {
 #if 0
 
 
-void on_dirlist_job_files_found(FmDirListJob* job, GSList* files, gpointer user_data) {
-    FmFolder* folder = FM_FOLDER(user_data);
-    GSList* l;
-    for(l = files; l; l = l->next) {
-        FmFileInfo* file = FM_FILE_INFO(l->data);
-        fm_file_info_list_push_tail(files, file);
-    }
-    if(G_UNLIKELY(!dir_fi && job->dir_fi))
-        /* we may want info while folder is still loading */
-    {
-        dir_fi = fm_file_info_ref(job->dir_fi);
-    }
-    g_signal_emit(folder, signals[FILES_ADDED], 0, files);
-}
-
 ErrorAction on_dirlist_job_error(FmDirListJob* job, GError* err, FmJobErrorSeverity severity, FmFolder* folder) {
     guint ret;
     /* it's possible that some signal handlers tries to free the folder
@@ -723,6 +918,8 @@ void Folder::reload() {
         has_idle_update_handler = false;
     }
 
+    cancelMimeTypeRefinement();
+
     /* remove all existing files */
     if(!files_.empty()) {
         // FIXME: this is not very efficient :(
@@ -767,12 +964,11 @@ void Folder::reload() {
     connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
     connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::BlockingQueuedConnection);
 
-#if 0
+    // let the files appear in batches while the folder is still being loaded
     if(wants_incremental) {
-        g_signal_connect(dirlist_job, "files-found", G_CALLBACK(on_dirlist_job_files_found), folder);
+        connect(dirlist_job, &DirListJob::filesFound, this, &Folder::onDirListFilesFound, Qt::BlockingQueuedConnection);
     }
-    fm_dir_list_job_set_incremental(dirlist_job, wants_incremental);
-#endif
+    dirlist_job->setIncremental(wants_incremental);
 
     dirlist_job->runAsync();
 
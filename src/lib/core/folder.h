@@ -25,16 +25,20 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
 #include <mutex>
 #include <functional>
 
 #include <QObject>
 #include <QtGlobal>
+#include <QElapsedTimer>
 #include "../libfmqtglobals.h"
 
 #include "gioptrs.h"
 #include "fileinfo.h"
 #include "job.h"
+#include "pathqueue.h"
 #include "volumemanager.h"
 
 namespace Fm {
@@ -90,6 +94,20 @@ public:
 
     void updateCutFiles();
 
+    // Asks for the content of a file whose mime type was only guessed from its name to be
+    // checked soon, before the files that are refined in the background, and for its gvfs
+    // metadata to be read if it was not. Called for the files being shown.
+    // filesChanged() is emitted if its mime type turns out to be different or it has metadata.
+    void refineFileInfo(const std::shared_ptr<const FileInfo>& file);
+
+    // Changes reported by the file monitor are applied at once when the folder is quiet.
+    // Under sustained churn, they are batched in a window growing from 250 ms to 1 s.
+    // Returns the current window in milliseconds (0 when changes are applied immediately).
+    int updateDelay() const;
+
+    // the number of file monitor events per second while the folder is changing, otherwise 0.
+    double changeRate() const;
+
     void forEachFile(std::function<void (const std::shared_ptr<const FileInfo>&)> func) const {
         std::lock_guard<std::mutex> lock{mutex_};
         for(auto it = files_.begin(); it != files_.end(); ++it) {
@@ -120,6 +138,9 @@ Q_SIGNALS:
 
     void fileSystemChanged();
 
+    // emitted when updateDelay() or changeRate() changes, e.g. to show a "live updating" indicator.
+    void updateRateChanged();
+
     // FIXME: this API design is bad. We leave this here to be compatible with the old libfm C API.
     // It might be better to remember the error state while loading the folder, and let the user of the
     // API handle the error on finish.
@@ -134,8 +155,15 @@ private:
     void onDirChanged(GFileMonitorEvent event_type);
 
     void queueUpdate();
+    void scheduleUpdate();
+    void updateChangeRate();
     void queueReload();
 
+    void addDirListFiles(const FileInfoList& infos, FileInfoList& files_to_add, std::vector<FileInfoPair>& files_to_update);
+
+    void queueMimeTypeRefinement(const FileInfoList& files);
+    void cancelMimeTypeRefinement();
+
     bool eventFileAdded(const FilePath &path);
     bool eventFileChanged(const FilePath &path);
     void eventFileDeleted(const FilePath &path);
@@ -144,14 +172,22 @@ private Q_SLOTS:
 
     void processPendingChanges();
 
+    void onDirListFilesFound(FileInfoList& foundFiles);
+
     void onDirListFinished();
 
     void onFileSystemInfoFinished();
 
     void onFileInfoFinished();
 
+    void processMimeTypeRefinement();
+
+    void onMimeTypeRefineFinished();
+
     void onIdleReload();
 
+    void onUpdateQuietCheck();
+
     void onMountAdded(const Mount& mnt);
 
     void onMountRemoved(const Mount& mnt);
@@ -170,13 +206,30 @@ private:
     /* for file monitor */
     bool has_idle_reload_handler;
     bool has_idle_update_handler;
-    FilePathList paths_to_add;
-    FilePathList paths_to_update;
-    FilePathList paths_to_del;
+    // keyed by basename; the folder itself is queued for update with an empty key
+    PathQueue paths_to_add;
+    PathQueue paths_to_update;
+    PathQueue paths_to_del;
     // GSList* pending_jobs;
     bool pending_change_notify;
     bool filesystem_info_pending;
 
+    /* adaptive coalescing of the updates */
+    QElapsedTimer lastUpdateTimer_; // started when the pending changes are processed
+    int updateDelay_;
+    double changeRate_;
+    unsigned int pendingEventCount_;
+
+    /* for the content-based refinement of guessed mime types */
+    FileInfoJob* mimeRefineJob_;
+    std::deque<std::shared_ptr<const FileInfo>> mimeRefineQueue_;
+    std::deque<std::shared_ptr<const FileInfo>> mimeRefineUrgentQueue_;
+    std::unordered_set<std::string> mimeRefineUrgentNames_;
+    std::unordered_set<std::string> mimeRefineStartedNames_;
+    // the infos which were refined without any change; FileInfo is immutable, so they stay
+    // guessed or pending
+    std::unordered_map<std::string, std::shared_ptr<const FileInfo>> confirmedFiles_;
+
     bool wants_incremental;
     bool stop_emission; /* don't set it 1 bit to not lock other bits */
 
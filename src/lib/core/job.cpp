@@ -1,10 +1,11 @@
 #include "job.h"
-#include "job_p.h"
+#include "jobexecutor.h"
 
 namespace Fm {
 
 Job::Job():
     paused_{false},
+    executionClass_{ExecutionClass::BACKGROUND},
     cancellable_{g_cancellable_new(), false},
     cancellableHandler_{g_signal_connect(cancellable_.get(), "cancelled", G_CALLBACK(_onCancellableCancelled), this)} {
 }
@@ -16,12 +17,10 @@ Job::~Job() {
 }
 
 void Job::runAsync(QThread::Priority priority) {
-    auto thread = new JobThread(this);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
     if(autoDelete()) {
         connect(this, &Job::finished, this, &Job::deleteLater);
     }
-    thread->start(priority);
+    JobExecutor::globalInstance()->start(this, priority);
 }
 
 void Job::cancel() {
@@ -40,7 +39,12 @@ Job::ErrorAction Job::emitError(const GErrorPtr &err, Job::ErrorSeverity severit
     if(err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_FAILED_HANDLED) {
         return response;
     }
-    Q_EMIT error(err, severity, response);
+    {
+        // waiting for the user, or for the prompt of another thread of the job
+        JobExecutor::BlockingWait wait;
+        std::lock_guard<std::mutex> lock{promptMutex_};
+        Q_EMIT error(err, severity, response);
+    }
 
     if(severity == ErrorSeverity::CRITICAL || response == ErrorAction::ABORT) {
         cancel();
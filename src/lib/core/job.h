@@ -25,6 +25,7 @@
 #include <QThread>
 #include <QRunnable>
 #include <memory>
+#include <mutex>
 #include <gio/gio.h>
 #include "gobjectptr.h"
 #include "gioptrs.h"
@@ -36,7 +37,7 @@ namespace Fm {
 /*
  * Fm::Job can be used in several different modes.
  * 1. run with QThreadPool::start()
- * 2. call runAsync(), which will create a new QThread and move the object to the thread.
+ * 2. call runAsync(), which will run the job in a thread of the shared JobExecutor.
  * 3. create a new QThread, and connect the started() signal to the slot Job::run()
  * 4. Directly call Job::run(), which executes synchrounously as a normal blocking call
 */
@@ -60,10 +61,26 @@ public:
         CRITICAL
     };
 
+    // the kind of work done by a job, which selects the thread pool used by runAsync()
+    enum class ExecutionClass {
+        INTERACTIVE, // listing folders and querying files the user is waiting for
+        BACKGROUND,  // information which is not needed at once (filesystem usage, refined mime types)
+        THUMBNAIL,
+        BULK_IO      // file operations
+    };
+
     explicit Job();
 
     ~Job() override;
 
+    ExecutionClass executionClass() const {
+        return executionClass_;
+    }
+
+    void setExecutionClass(ExecutionClass executionClass) {
+        executionClass_ = executionClass;
+    }
+
     bool isCancelled() const {
         return g_cancellable_is_cancelled(cancellable_.get());
     }
@@ -93,11 +110,16 @@ public Q_SLOTS:
     void run() override;
 
 protected:
+    // thread-safe: errors emitted by several worker threads of a job are shown one at a time.
     ErrorAction emitError(const GErrorPtr& err, ErrorSeverity severity = ErrorSeverity::MODERATE);
 
     // all derived job subclasses should do their work in this method.
     virtual void exec() = 0;
 
+    // held while a signal waiting for the user's answer is emitted, so that the prompts of
+    // the worker threads of a job, errors or others, are shown one at a time
+    std::mutex promptMutex_;
+
 private:
     static void _onCancellableCancelled(GCancellable* cancellable, Job* _this) {
         _this->onCancellableCancelled(cancellable);
@@ -109,6 +131,7 @@ private:
 
 private:
     bool paused_;
+    ExecutionClass executionClass_;
     GCancellablePtr cancellable_;
     gulong cancellableHandler_;
 };
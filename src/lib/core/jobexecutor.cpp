@@ -0,0 +1,229 @@
+#include "jobexecutor.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <QElapsedTimer>
+
+namespace Fm {
+
+namespace {
+
+// the pool whose thread runs the current thread, if it belongs to the executor
+thread_local QThreadPool* currentPool = nullptr;
+// the nested BlockingWait objects of the current thread, which only release it once
+thread_local int blockingWaitDepth = 0;
+
+// the parts of a runInParallel() call, shared with the pool threads, which may only start
+// after the call returned; then no part is left for them and func is not used
+class ParallelRun {
+public:
+    explicit ParallelRun(int count, const std::function<void(int)>& func):
+        func_{func},
+        count_{count},
+        next_{0},
+        done_{0} {
+    }
+
+    // runs the next part, if any is left
+    bool runNext() {
+        int part = next_.fetch_add(1);
+        if(part >= count_) {
+            return false;
+        }
+        func_(part);
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(++done_ == count_) {
+            finished_.notify_all();
+        }
+        return true;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        finished_.wait(lock, [this] {
+            return done_ == count_;
+        });
+    }
+
+private:
+    const std::function<void(int)>& func_;
+    const int count_;
+    std::atomic<int> next_;
+    int done_;
+    std::mutex mutex_;
+    std::condition_variable finished_;
+};
+
+class ParallelRunner: public QRunnable {
+public:
+    explicit ParallelRunner(std::shared_ptr<ParallelRun> parallelRun, QThreadPool* pool):
+        parallelRun_{std::move(parallelRun)},
+        pool_{pool} {
+    }
+
+    void run() override {
+        currentPool = pool_;
+        while(parallelRun_->runNext()) {
+        }
+        currentPool = nullptr;
+    }
+
+private:
+    std::shared_ptr<ParallelRun> parallelRun_;
+    QThreadPool* pool_;
+};
+
+} // namespace
+
+// runs a job in the pool of its execution class
+class JobExecutor::Runner: public QRunnable {
+public:
+    explicit Runner(JobExecutor* executor, Job* job, int lane, QThread::Priority priority):
+        executor_{executor},
+        job_{job},
+        lane_{lane},
+        priority_{priority} {
+        queuedTimer_.start();
+    }
+
+    void run() override {
+        auto& lane = executor_->lanes_[lane_];
+        qint64 latency = queuedTimer_.elapsed();
+        bool cancelled = job_->isCancelled();
+        {
+            std::lock_guard<std::mutex> lock{executor_->mutex_};
+            --lane.queued;
+            ++lane.running;
+            ++lane.started;
+            lane.totalLatency += latency;
+            lane.maxLatency = std::max(lane.maxLatency, std::int64_t(latency));
+            if(cancelled) {
+                ++lane.cancelled;
+            }
+        }
+
+        if(cancelled) {
+            // skip the work, but let the receivers of finished() clean up
+            Q_EMIT job_->finished();
+        }
+        else {
+            auto thread = QThread::currentThread();
+            if(priority_ != QThread::InheritPriority) {
+                thread->setPriority(priority_);
+            }
+            currentPool = &lane.pool;
+            job_->run();
+            currentPool = nullptr;
+            if(priority_ != QThread::InheritPriority) {
+                thread->setPriority(QThread::NormalPriority);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{executor_->mutex_};
+        --lane.running;
+    }
+
+private:
+    JobExecutor* executor_;
+    Job* job_;
+    int lane_;
+    QThread::Priority priority_;
+    QElapsedTimer queuedTimer_;
+};
+
+JobExecutor::JobExecutor() {
+    // several folders may be listed at once and a remote one may block for a while
+    setMaxThreadCount(Job::ExecutionClass::INTERACTIVE, std::max(QThread::idealThreadCount(), 8));
+    setMaxThreadCount(Job::ExecutionClass::BACKGROUND, 4);
+    setMaxThreadCount(Job::ExecutionClass::THUMBNAIL, 2);
+    // every file operation has its own progress dialog, so few of them should wait
+    setMaxThreadCount(Job::ExecutionClass::BULK_IO, 16);
+}
+
+// static
+JobExecutor* JobExecutor::globalInstance() {
+    // never deleted so that no job is waited for at exit
+    static JobExecutor* instance = new JobExecutor();
+    return instance;
+}
+
+void JobExecutor::start(Job* job, QThread::Priority priority) {
+    int lane = static_cast<int>(job->executionClass());
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        ++lanes_[lane].queued;
+    }
+    lanes_[lane].pool.start(new Runner{this, job, lane, priority});
+}
+
+void JobExecutor::runInParallel(Job::ExecutionClass executionClass, int count, const std::function<void(int)>& func) {
+    if(count <= 1) {
+        if(count == 1) {
+            func(0);
+        }
+        return;
+    }
+    auto parallelRun = std::make_shared<ParallelRun>(count, func);
+    auto& pool = lanes_[static_cast<int>(executionClass)].pool;
+    const int helpers = std::min(count - 1, pool.maxThreadCount());
+    for(int i = 0; i < helpers; ++i) {
+        pool.start(new ParallelRunner{parallelRun, &pool});
+    }
+    while(parallelRun->runNext()) {
+    }
+    parallelRun->wait();
+}
+
+JobExecutor::BlockingWait::BlockingWait(bool blocking):
+    pool_{nullptr},
+    nested_{blocking && currentPool} {
+    if(nested_ && blockingWaitDepth++ == 0) {
+        pool_ = currentPool;
+        pool_->releaseThread();
+    }
+}
+
+JobExecutor::BlockingWait::~BlockingWait() {
+    if(pool_) {
+        // may exceed the bound for a while, until a thread of the pool is free
+        pool_->reserveThread();
+    }
+    if(nested_) {
+        --blockingWaitDepth;
+    }
+}
+
+void JobExecutor::setMaxThreadCount(Job::ExecutionClass executionClass, int count) {
+    lanes_[static_cast<int>(executionClass)].pool.setMaxThreadCount(std::max(count, 1));
+}
+
+int JobExecutor::maxThreadCount(Job::ExecutionClass executionClass) const {
+    return lanes_[static_cast<int>(executionClass)].pool.maxThreadCount();
+}
+
+JobExecutor::Stats JobExecutor::stats(Job::ExecutionClass executionClass) const {
+    const auto& lane = lanes_[static_cast<int>(executionClass)];
+    std::lock_guard<std::mutex> lock{mutex_};
+    Stats stats;
+    stats.maxThreadCount = lane.pool.maxThreadCount();
+    stats.queued = lane.queued;
+    stats.running = lane.running;
+    stats.started = lane.started;
+    stats.cancelled = lane.cancelled;
+    stats.averageLatency = lane.started > 0 ? double(lane.totalLatency) / lane.started : 0.0;
+    stats.maxLatency = lane.maxLatency;
+    return stats;
+}
+
+void JobExecutor::resetStats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for(auto& lane: lanes_) {
+        lane.started = 0;
+        lane.cancelled = 0;
+        lane.totalLatency = 0;
+        lane.maxLatency = 0;
+    }
+}
+
+} // namespace Fm
@@ -0,0 +1,95 @@
+#ifndef FM2_JOBEXECUTOR_H
+#define FM2_JOBEXECUTOR_H
+
+#include "../libfmqtglobals.h"
+#include <QThread>
+#include <QThreadPool>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "job.h"
+
+namespace Fm {
+
+/*
+ * The shared executor of Job::runAsync().
+ *
+ * Each Job::ExecutionClass has its own bounded pool of reusable threads, so a storm of
+ * short jobs does not create a thread per job and long file operations cannot hold
+ * the threads needed to list folders. A job cancelled while it is queued is not run,
+ * but its finished() signal is still emitted.
+ *
+ * The bounds are for the threads using the CPU or local disks. A thread waiting for something
+ * else does not count while it waits in a BlockingWait, so the other jobs of its pool are not
+ * held by it: the jobs waiting for the user's answer to a prompt, and the ones listing or
+ * querying non-native filesystems (remote, MTP...), which may hang for a long time.
+ */
+class LIBFM_QT_API JobExecutor {
+public:
+    // counters of one execution class, to tune the thread counts
+    struct Stats {
+        int maxThreadCount;
+        int queued;               // jobs waiting for a thread
+        int running;
+        std::uint64_t started;    // jobs which left the queue, including the cancelled ones
+        std::uint64_t cancelled;  // jobs cancelled before they could run
+        double averageLatency;    // milliseconds between runAsync() and the start of a job
+        std::int64_t maxLatency;  // milliseconds
+    };
+
+    static JobExecutor* globalInstance();
+
+    // while it exists, the thread running a job of the executor does not count in the bound
+    // of its pool, which may start another one; nothing is done in the other threads
+    class LIBFM_QT_API BlockingWait {
+    public:
+        explicit BlockingWait(bool blocking = true);
+
+        ~BlockingWait();
+
+        BlockingWait(const BlockingWait&) = delete;
+        BlockingWait& operator=(const BlockingWait&) = delete;
+
+    private:
+        QThreadPool* pool_; // the pool of the thread, if released
+        bool nested_;       // counted in the blocking waits of the thread
+    };
+
+    void start(Job* job, QThread::Priority priority = QThread::InheritPriority);
+
+    // runs func(0) ... func(count - 1) with the threads of the pool of executionClass and the
+    // calling thread, and returns when all are done. The calling thread runs the parts no
+    // pool thread is free for, so a job may call it without waiting for its own pool.
+    void runInParallel(Job::ExecutionClass executionClass, int count, const std::function<void(int)>& func);
+
+    void setMaxThreadCount(Job::ExecutionClass executionClass, int count);
+
+    int maxThreadCount(Job::ExecutionClass executionClass) const;
+
+    Stats stats(Job::ExecutionClass executionClass) const;
+
+    void resetStats();
+
+private:
+    explicit JobExecutor();
+
+    class Runner;
+
+    struct Lane {
+        QThreadPool pool;
+        int queued = 0;
+        int running = 0;
+        std::uint64_t started = 0;
+        std::uint64_t cancelled = 0;
+        std::int64_t totalLatency = 0;
+        std::int64_t maxLatency = 0;
+    };
+
+    static const int laneCount = 4;
+    Lane lanes_[laneCount];
+    mutable std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_JOBEXECUTOR_H
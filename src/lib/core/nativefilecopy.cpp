@@ -0,0 +1,403 @@
+#include "nativefilecopy.h"
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <QObject>
+#include <QString>
+
+namespace Fm {
+
+namespace {
+
+// the amount of data copied between two progress updates and cancellation checks
+constexpr size_t copyChunkSize = 8 * 1024 * 1024;
+// the buffer size of the read/write fallback
+constexpr size_t copyBufferSize = 1024 * 1024;
+
+GErrorPtr errorFromErrno(int errsv, const QString& format, const std::string& path) {
+    auto msg = format.arg(QString::fromUtf8(path.c_str()), QString::fromUtf8(g_strerror(errsv)));
+    return GErrorPtr{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)), msg};
+}
+
+// errors telling that a kernel copy method cannot be used for this pair of files
+bool isUnsupportedError(int errsv) {
+    return errsv == ENOSYS || errsv == EXDEV || errsv == EINVAL || errsv == EOPNOTSUPP
+            || errsv == ENOTSUP || errsv == ENOTTY || errsv == EBADF || errsv == EPERM;
+}
+
+} // namespace
+
+NativeFileCopy::NativeFileCopy(const char* srcPath, const char* destPath):
+    srcPath_{srcPath},
+    destPath_{destPath},
+    srcFd_{-1},
+    destFd_{-1},
+    totalSize_{0},
+    allocatedSize_{0},
+    sparse_{false},
+    copied_{0},
+    progressCallback_{nullptr},
+    progressData_{nullptr} {
+}
+
+NativeFileCopy::~NativeFileCopy() {
+    if(srcFd_ >= 0) {
+        close(srcFd_);
+    }
+    if(destFd_ >= 0) {
+        close(destFd_);
+    }
+}
+
+bool NativeFileCopy::run(GFileCopyFlags flags, GCancellable* cancellable,
+                         GFileProgressCallback progressCallback, gpointer progressData, GErrorPtr& err) {
+    progressCallback_ = progressCallback;
+    progressData_ = progressData;
+
+    srcFd_ = open(srcPath_.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if(srcFd_ < 0) {
+        int errsv = errno;
+        if(errsv == ELOOP) { // a symlink
+            err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, QObject::tr("Not a regular file")};
+        }
+        else {
+            err = errorFromErrno(errsv, QObject::tr("Error opening file “%1”: %2"), srcPath_);
+        }
+        return false;
+    }
+
+    struct stat srcStat;
+    if(fstat(srcFd_, &srcStat) != 0) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, QObject::tr("Error when getting information for file “%1”: %2"), srcPath_);
+        return false;
+    }
+    if(!S_ISREG(srcStat.st_mode)) {
+        err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, QObject::tr("Not a regular file")};
+        return false;
+    }
+    totalSize_ = srcStat.st_size;
+    allocatedSize_ = off_t(srcStat.st_blocks) * 512;
+    sparse_ = (allocatedSize_ < totalSize_);
+
+    if(!openDest(srcStat, flags, err)) {
+        return false;
+    }
+
+    // an existing file is replaced by a temporary one only once it is complete
+    const std::string& writePath = tmpPath_.empty() ? destPath_ : tmpPath_;
+    bool ret = copyData(cancellable, err);
+    if(close(destFd_) != 0 && ret) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+        ret = false;
+    }
+    destFd_ = -1;
+
+    if(!ret) {
+        // do not leave partial content behind
+        unlink(writePath.c_str());
+        return false;
+    }
+
+    if(flags & G_FILE_COPY_ALL_METADATA) {
+        // like g_file_copy(), ignore the errors since the destination filesystem may not
+        // support all attributes.
+        GFilePtr src{g_file_new_for_path(srcPath_.c_str()), false};
+        GFilePtr dest{g_file_new_for_path(writePath.c_str()), false};
+        g_file_copy_attributes(src.get(), dest.get(),
+                               GFileCopyFlags(G_FILE_COPY_ALL_METADATA | G_FILE_COPY_NOFOLLOW_SYMLINKS),
+                               cancellable, nullptr);
+    }
+
+    if(!tmpPath_.empty() && rename(tmpPath_.c_str(), destPath_.c_str()) != 0) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+        unlink(tmpPath_.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool NativeFileCopy::openDest(const struct stat& srcStat, GFileCopyFlags flags, GErrorPtr& err) {
+    const int oflags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    const mode_t mode = srcStat.st_mode & 0777;
+    destFd_ = open(destPath_.c_str(), oflags, mode);
+    if(destFd_ < 0 && errno == EEXIST && (flags & G_FILE_COPY_OVERWRITE)) {
+        struct stat destStat;
+        if(lstat(destPath_.c_str(), &destStat) == 0) {
+            if(S_ISDIR(destStat.st_mode)) {
+                err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                                QObject::tr("Cannot copy over directory “%1”").arg(QString::fromUtf8(destPath_.c_str()))};
+                return false;
+            }
+            if(destStat.st_dev == srcStat.st_dev && destStat.st_ino == srcStat.st_ino) {
+                err = GErrorPtr{G_IO_ERROR, G_IO_ERROR_FAILED,
+                                QObject::tr("Cannot copy file “%1” over itself").arg(QString::fromUtf8(srcPath_.c_str()))};
+                return false;
+            }
+        }
+        // the data is written to a new file in the same directory, which replaces the old one
+        // with rename() when it is complete, so a failed copy leaves the old file untouched
+        auto slash = destPath_.rfind('/');
+        std::string tmpPath = destPath_.substr(0, slash + 1) + '.' + destPath_.substr(slash + 1) + ".XXXXXX";
+        destFd_ = g_mkstemp_full(&tmpPath[0], O_WRONLY | O_CLOEXEC, mode);
+        if(destFd_ >= 0) {
+            tmpPath_ = std::move(tmpPath);
+        }
+    }
+    if(destFd_ < 0) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, QObject::tr("Error opening file “%1”: %2"), destPath_);
+        return false;
+    }
+    return true;
+}
+
+bool NativeFileCopy::copyData(GCancellable* cancellable, GErrorPtr& err) {
+    reportProgress();
+    Result result = Result::NOT_SUPPORTED;
+    // files like those in /proc may report a size of 0 but still have content.
+    if(totalSize_ > 0) {
+        result = reflink();
+        if(result == Result::NOT_SUPPORTED && sparse_) {
+            result = sparseCopy(cancellable, err);
+        }
+        if(result == Result::NOT_SUPPORTED) {
+            sparse_ = false;
+            result = copyFileRange(cancellable, err);
+        }
+        if(result == Result::NOT_SUPPORTED) {
+            result = sendFile(cancellable, err);
+        }
+    }
+    if(result == Result::NOT_SUPPORTED) {
+        result = readWrite(cancellable, err);
+    }
+    if(result == Result::DONE) {
+        reportProgress();
+    }
+    return result == Result::DONE;
+}
+
+NativeFileCopy::Result NativeFileCopy::reflink() {
+#ifdef FICLONE
+    if(ioctl(destFd_, FICLONE, srcFd_) == 0) {
+        copied_ = sparse_ ? allocatedSize_ : totalSize_;
+        return Result::DONE;
+    }
+#endif
+    // any error only means that the data cannot be shared
+    return Result::NOT_SUPPORTED;
+}
+
+NativeFileCopy::Result NativeFileCopy::sparseCopy(GCancellable* cancellable, GErrorPtr& err) {
+    off_t offset = 0;
+    while(offset < totalSize_) {
+        off_t dataStart = lseek(srcFd_, offset, SEEK_DATA);
+        if(dataStart < 0) {
+            int errsv = errno;
+            if(errsv == ENXIO) { // only a hole is left
+                break;
+            }
+            if(offset == 0 && isUnsupportedError(errsv)) {
+                return Result::NOT_SUPPORTED;
+            }
+            err = errorFromErrno(errsv, QObject::tr("Error reading file “%1”: %2"), srcPath_);
+            return Result::FAILED;
+        }
+        off_t dataEnd = lseek(srcFd_, dataStart, SEEK_HOLE);
+        if(dataEnd < 0) {
+            int errsv = errno;
+            err = errorFromErrno(errsv, QObject::tr("Error reading file “%1”: %2"), srcPath_);
+            return Result::FAILED;
+        }
+        // the destination is a new file, so the skipped ranges stay holes
+        if(!copyRange(dataStart, dataEnd, cancellable, err)) {
+            return Result::FAILED;
+        }
+        offset = dataEnd;
+    }
+    // restore the hole at the end of the file, if any
+    if(ftruncate(destFd_, totalSize_) != 0) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+        return Result::FAILED;
+    }
+    return Result::DONE;
+}
+
+bool NativeFileCopy::copyRange(off_t start, off_t end, GCancellable* cancellable, GErrorPtr& err) {
+    loff_t srcOffset = start;
+    loff_t destOffset = start;
+    bool useCopyFileRange = true;
+    std::vector<char> buf;
+    while(srcOffset < end) {
+        if(g_cancellable_set_error_if_cancelled(cancellable, &err)) {
+            return false;
+        }
+        size_t len = std::min(size_t(end - srcOffset), copyChunkSize);
+        ssize_t n;
+        if(useCopyFileRange) {
+            n = copy_file_range(srcFd_, &srcOffset, destFd_, &destOffset, len, 0);
+            if(n < 0 && errno != EINTR && isUnsupportedError(errno)) {
+                // the offsets are explicit, so the rest can be copied with pread() and pwrite()
+                useCopyFileRange = false;
+                continue;
+            }
+            if(n == 0) { // the file was truncated meanwhile or the filesystem refuses to copy
+                useCopyFileRange = false;
+                continue;
+            }
+        }
+        else {
+            if(buf.empty()) {
+                buf.resize(copyBufferSize);
+            }
+            n = pread(srcFd_, buf.data(), std::min(len, buf.size()), srcOffset);
+            if(n == 0) { // truncated meanwhile
+                return true;
+            }
+            if(n > 0) {
+                const char* p = buf.data();
+                ssize_t left = n;
+                while(left > 0) {
+                    ssize_t written = pwrite(destFd_, p, left, destOffset);
+                    if(written < 0) {
+                        int errsv = errno;
+                        if(errsv == EINTR) {
+                            continue;
+                        }
+                        err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+                        return false;
+                    }
+                    p += written;
+                    left -= written;
+                    destOffset += written;
+                }
+                srcOffset += n;
+            }
+        }
+        if(n < 0) {
+            int errsv = errno;
+            if(errsv == EINTR) {
+                continue;
+            }
+            err = errorFromErrno(errsv, useCopyFileRange ? QObject::tr("Error writing file “%1”: %2") : QObject::tr("Error reading file “%1”: %2"),
+                                 useCopyFileRange ? destPath_ : srcPath_);
+            return false;
+        }
+        copied_ += n;
+        reportProgress();
+    }
+    return true;
+}
+
+NativeFileCopy::Result NativeFileCopy::copyFileRange(GCancellable* cancellable, GErrorPtr& err) {
+    loff_t srcOffset = copied_;
+    loff_t destOffset = copied_;
+    for(;;) {
+        if(g_cancellable_set_error_if_cancelled(cancellable, &err)) {
+            return Result::FAILED;
+        }
+        ssize_t n = copy_file_range(srcFd_, &srcOffset, destFd_, &destOffset, copyChunkSize, 0);
+        if(n < 0) {
+            int errsv = errno;
+            if(errsv == EINTR) {
+                continue;
+            }
+            if(copied_ == 0 && isUnsupportedError(errsv)) {
+                return Result::NOT_SUPPORTED;
+            }
+            err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+            return Result::FAILED;
+        }
+        if(n == 0) { // EOF
+            // some filesystems report success without copying anything
+            return copied_ == 0 ? Result::NOT_SUPPORTED : Result::DONE;
+        }
+        copied_ += n;
+        reportProgress();
+    }
+}
+
+NativeFileCopy::Result NativeFileCopy::sendFile(GCancellable* cancellable, GErrorPtr& err) {
+    off_t srcOffset = copied_;
+    if(lseek(destFd_, copied_, SEEK_SET) < 0) {
+        return copied_ == 0 ? Result::NOT_SUPPORTED : Result::FAILED;
+    }
+    for(;;) {
+        if(g_cancellable_set_error_if_cancelled(cancellable, &err)) {
+            return Result::FAILED;
+        }
+        ssize_t n = sendfile(destFd_, srcFd_, &srcOffset, copyChunkSize);
+        if(n < 0) {
+            int errsv = errno;
+            if(errsv == EINTR) {
+                continue;
+            }
+            if(copied_ == 0 && isUnsupportedError(errsv)) {
+                return Result::NOT_SUPPORTED;
+            }
+            err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+            return Result::FAILED;
+        }
+        if(n == 0) { // EOF
+            return copied_ == 0 ? Result::NOT_SUPPORTED : Result::DONE;
+        }
+        copied_ += n;
+        reportProgress();
+    }
+}
+
+NativeFileCopy::Result NativeFileCopy::readWrite(GCancellable* cancellable, GErrorPtr& err) {
+    std::vector<char> buf(copyBufferSize);
+    for(;;) {
+        if(g_cancellable_set_error_if_cancelled(cancellable, &err)) {
+            return Result::FAILED;
+        }
+        ssize_t n = pread(srcFd_, buf.data(), buf.size(), copied_);
+        if(n < 0) {
+            int errsv = errno;
+            if(errsv == EINTR) {
+                continue;
+            }
+            err = errorFromErrno(errsv, QObject::tr("Error reading file “%1”: %2"), srcPath_);
+            return Result::FAILED;
+        }
+        if(n == 0) { // EOF
+            return Result::DONE;
+        }
+        const char* p = buf.data();
+        while(n > 0) {
+            ssize_t written = pwrite(destFd_, p, n, copied_);
+            if(written < 0) {
+                int errsv = errno;
+                if(errsv == EINTR) {
+                    continue;
+                }
+                err = errorFromErrno(errsv, QObject::tr("Error writing file “%1”: %2"), destPath_);
+                return Result::FAILED;
+            }
+            p += written;
+            n -= written;
+            copied_ += written;
+        }
+        reportProgress();
+    }
+}
+
+void NativeFileCopy::reportProgress() {
+    if(progressCallback_) {
+        off_t total = sparse_ ? allocatedSize_ : totalSize_;
+        progressCallback_(copied_, std::max(total, copied_), progressData_);
+    }
+}
+
+} // namespace Fm
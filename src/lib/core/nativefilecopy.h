@@ -0,0 +1,81 @@
+#ifndef FM2_NATIVEFILECOPY_H
+#define FM2_NATIVEFILECOPY_H
+
+#include "../libfmqtglobals.h"
+#include <gio/gio.h>
+#include <sys/types.h>
+#include <string>
+#include "gioptrs.h"
+
+namespace Fm {
+
+/*
+ * Fast path of FileTransferJob for copying a regular file between native filesystems.
+ *
+ * The data is copied by the kernel whenever possible, trying in this order:
+ * 1. a reflink (FICLONE), which shares the data on copy-on-write filesystems (btrfs, XFS)
+ * 2. copy_file_range(), which may be offloaded to the filesystem or the storage
+ * 3. sendfile()
+ * 4. read() and write() with a large buffer
+ * Sparse files (with fewer allocated blocks than their size) keep their holes: only the
+ * data extents found with SEEK_DATA/SEEK_HOLE are copied and the holes are skipped.
+ * The progress of a sparse file is reported in bytes of data out of its allocated size.
+ * Metadata is copied afterwards with g_file_copy_attributes() like g_file_copy() does.
+ * With G_FILE_COPY_OVERWRITE, an existing file is replaced only when the copy is complete:
+ * the data is copied to a temporary file in the same directory which is then renamed.
+ *
+ * Only G_FILE_COPY_OVERWRITE and G_FILE_COPY_ALL_METADATA are handled and symlinks are
+ * never followed. If the source is not a regular file, G_IO_ERROR_NOT_SUPPORTED is
+ * returned and g_file_copy() should be used instead.
+ */
+class NativeFileCopy {
+public:
+    explicit NativeFileCopy(const char* srcPath, const char* destPath);
+
+    ~NativeFileCopy();
+
+    NativeFileCopy(const NativeFileCopy& other) = delete;
+
+    NativeFileCopy& operator = (const NativeFileCopy& other) = delete;
+
+    // the progress callback is called from the calling thread, like with g_file_copy().
+    bool run(GFileCopyFlags flags, GCancellable* cancellable,
+             GFileProgressCallback progressCallback, gpointer progressData, GErrorPtr& err);
+
+private:
+    enum class Result {
+        DONE,
+        NOT_SUPPORTED, // nothing was copied, try the next method
+        FAILED
+    };
+
+    bool openDest(const struct stat& srcStat, GFileCopyFlags flags, GErrorPtr& err);
+
+    bool copyData(GCancellable* cancellable, GErrorPtr& err);
+
+    Result reflink();
+    Result sparseCopy(GCancellable* cancellable, GErrorPtr& err);
+    bool copyRange(off_t start, off_t end, GCancellable* cancellable, GErrorPtr& err);
+    Result copyFileRange(GCancellable* cancellable, GErrorPtr& err);
+    Result sendFile(GCancellable* cancellable, GErrorPtr& err);
+    Result readWrite(GCancellable* cancellable, GErrorPtr& err);
+
+    void reportProgress();
+
+private:
+    std::string srcPath_;
+    std::string destPath_;
+    std::string tmpPath_; // the file written instead of an existing destPath_, if any
+    int srcFd_;
+    int destFd_;
+    off_t totalSize_;
+    off_t allocatedSize_;
+    bool sparse_;
+    off_t copied_; // bytes of data copied so far
+    GFileProgressCallback progressCallback_;
+    gpointer progressData_;
+};
+
+} // namespace Fm
+
+#endif // FM2_NATIVEFILECOPY_H
@@ -0,0 +1,346 @@
+#include "nativefileinfo.h"
+#include "fileinfo_p.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <QString>
+
+namespace Fm {
+
+namespace {
+
+// the layout of the records returned by the getdents64 system call
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+GErrorPtr errorFromErrno(int errsv, const char* format, const std::string& path) {
+    auto msg = QString::fromUtf8(format).arg(QString::fromUtf8(path.c_str()), QString::fromUtf8(g_strerror(errsv)));
+    return GErrorPtr{G_IO_ERROR, static_cast<unsigned int>(g_io_error_from_errno(errsv)), msg};
+}
+
+// stat a file relative to dirFd with the minimal set of fields needed by FileInfo
+int statAt(int dirFd, const char* name, bool followSymlink, struct stat& st) {
+    int flags = AT_NO_AUTOMOUNT | (followSymlink ? 0 : AT_SYMLINK_NOFOLLOW);
+#ifdef STATX_BASIC_STATS
+    struct statx stx;
+    const unsigned int mask = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID
+                              | STATX_ATIME | STATX_MTIME | STATX_CTIME | STATX_INO
+                              | STATX_SIZE | STATX_BLOCKS;
+    if(statx(dirFd, name, flags, mask, &stx) == 0) {
+        memset(&st, 0, sizeof(st));
+        st.st_mode = stx.stx_mode;
+        st.st_nlink = stx.stx_nlink;
+        st.st_uid = stx.stx_uid;
+        st.st_gid = stx.stx_gid;
+        st.st_ino = stx.stx_ino;
+        st.st_size = stx.stx_size;
+        st.st_blocks = stx.stx_blocks;
+        st.st_blksize = stx.stx_blksize;
+        st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        st.st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+        st.st_atim.tv_sec = stx.stx_atime.tv_sec;
+        st.st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+        st.st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+        st.st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+        st.st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+        st.st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+        return 0;
+    }
+    if(errno != ENOSYS) {
+        return -1;
+    }
+    // statx() is not supported by the kernel; fall back to fstatat()
+#endif
+    return fstatat(dirFd, name, &st, flags);
+}
+
+GFileType fileTypeFromMode(mode_t mode) {
+    switch(mode & S_IFMT) {
+    case S_IFREG:
+        return G_FILE_TYPE_REGULAR;
+    case S_IFDIR:
+        return G_FILE_TYPE_DIRECTORY;
+    case S_IFLNK:
+        return G_FILE_TYPE_SYMBOLIC_LINK;
+    case S_IFCHR:
+    case S_IFBLK:
+    case S_IFIFO:
+    case S_IFSOCK:
+        return G_FILE_TYPE_SPECIAL;
+    default:
+        return G_FILE_TYPE_UNKNOWN;
+    }
+}
+
+// the same content types that GIO uses for non-regular files, and a guess from the name otherwise
+CStrPtr contentTypeFromStat(const char* name, const struct stat& st, gboolean* uncertain) {
+    *uncertain = false;
+    switch(st.st_mode & S_IFMT) {
+    case S_IFDIR:
+        return CStrPtr{g_strdup("inode/directory")};
+    case S_IFLNK: // a broken symlink
+        return CStrPtr{g_strdup("inode/symlink")};
+    case S_IFCHR:
+        return CStrPtr{g_strdup("inode/chardevice")};
+    case S_IFBLK:
+        return CStrPtr{g_strdup("inode/blockdevice")};
+    case S_IFIFO:
+        return CStrPtr{g_strdup("inode/fifo")};
+    case S_IFSOCK:
+        return CStrPtr{g_strdup("inode/socket")};
+    default:
+        break;
+    }
+    if(st.st_size == 0) {
+        return CStrPtr{g_strdup("application/x-zerosize")};
+    }
+    return CStrPtr{g_content_type_guess(name, nullptr, 0, uncertain)};
+}
+
+// without the metadata store of gvfs, no file has any "metadata::*" attribute
+bool hasMetadataStore() {
+    static const bool hasStore = [] {
+        CStrPtr dir{g_build_filename(g_get_user_data_dir(), "gvfs-metadata", nullptr)};
+        return bool(g_file_test(dir.get(), G_FILE_TEST_IS_DIR));
+    }();
+    return hasStore;
+}
+
+void copyMetadata(GFileInfo* src, GFileInfo* dest) {
+    CStrArrayPtr attrs{g_file_info_list_attributes(src, "metadata")};
+    for(int i = 0; attrs && attrs[i]; ++i) {
+        GFileAttributeType type;
+        gpointer value;
+        if(g_file_info_get_attribute_data(src, attrs[i], &type, &value, nullptr)) {
+            g_file_info_set_attribute(dest, attrs[i], type, value);
+        }
+    }
+}
+
+} // namespace
+
+
+NativeFileInfoQuery::NativeFileInfoQuery(int dirFd, const char* dirPath):
+    dirFd_{dirFd},
+    dirPath_{dirPath},
+    dirWritable_{false},
+    uid_{getuid()},
+    gid_{getgid()} {
+    if(fstat(dirFd_, &dirStat_) == 0) {
+        // GIO uses access() for the "access::*" attributes, which checks the real uid.
+        dirWritable_ = (faccessat(dirFd_, ".", W_OK | X_OK, 0) == 0);
+    }
+    else {
+        memset(&dirStat_, 0, sizeof(dirStat_));
+    }
+    int n_groups = getgroups(0, nullptr);
+    if(n_groups > 0) {
+        groups_.resize(n_groups);
+        n_groups = getgroups(n_groups, groups_.data());
+        groups_.resize(n_groups > 0 ? n_groups : 0);
+    }
+    loadHiddenNames();
+}
+
+void NativeFileInfoQuery::loadHiddenNames() {
+    int fd = openat(dirFd_, ".hidden", O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    std::string content;
+    char buf[4096];
+    ssize_t len;
+    while((len = read(fd, buf, sizeof(buf))) > 0) {
+        content.append(buf, len);
+    }
+    close(fd);
+
+    size_t start = 0;
+    while(start < content.size()) {
+        size_t end = content.find('\n', start);
+        if(end == std::string::npos) {
+            end = content.size();
+        }
+        if(end > start) {
+            hiddenNames_.emplace(content, start, end - start);
+        }
+        start = end + 1;
+    }
+}
+
+bool NativeFileInfoQuery::canAccess(const struct stat& st, int bits) const {
+    if(uid_ == 0) { // root can read and write anything, but can only execute files with an x bit
+        return (bits & X_OK) == 0 || S_ISDIR(st.st_mode) || (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+    }
+    mode_t mode;
+    if(st.st_uid == uid_) {
+        mode = (st.st_mode >> 6) & 7;
+    }
+    else if(st.st_gid == gid_ || std::find(groups_.cbegin(), groups_.cend(), st.st_gid) != groups_.cend()) {
+        mode = (st.st_mode >> 3) & 7;
+    }
+    else {
+        mode = st.st_mode & 7;
+    }
+    return (mode & bits) == static_cast<mode_t>(bits);
+}
+
+GFileInfoPtr NativeFileInfoQuery::query(const char* name, GErrorPtr& err) const {
+    struct stat st;
+    if(statAt(dirFd_, name, false, st) != 0) {
+        int errsv = errno;
+        err = errorFromErrno(errsv, "Error when getting information for file “%1”: %2", dirPath_ + '/' + name);
+        return GFileInfoPtr{};
+    }
+
+    GFileInfoPtr info{g_file_info_new(), false};
+    auto inf = info.get();
+
+    bool isSymlink = S_ISLNK(st.st_mode);
+    if(isSymlink) {
+        g_file_info_set_is_symlink(inf, true);
+        std::vector<char> target(st.st_size > 0 ? st.st_size + 1 : PATH_MAX);
+        ssize_t len = readlinkat(dirFd_, name, target.data(), target.size() - 1);
+        if(len >= 0) {
+            target[len] = '\0';
+            g_file_info_set_symlink_target(inf, target.data());
+        }
+        // like GIO without G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, describe the target if it exists
+        struct stat targetSt;
+        if(statAt(dirFd_, name, true, targetSt) == 0) {
+            st = targetSt;
+        }
+    }
+    else {
+        g_file_info_set_is_symlink(inf, false);
+    }
+
+    g_file_info_set_name(inf, name);
+    CStrPtr dispName{g_filename_display_name(name)};
+    g_file_info_set_display_name(inf, dispName.get());
+    g_file_info_set_edit_name(inf, dispName.get());
+    g_file_info_set_file_type(inf, fileTypeFromMode(st.st_mode));
+    g_file_info_set_is_hidden(inf, name[0] == '.' || hiddenNames_.count(name) > 0);
+    g_file_info_set_is_backup(inf, g_str_has_suffix(name, "~"));
+    g_file_info_set_size(inf, st.st_size);
+
+    gboolean uncertain;
+    auto contentType = contentTypeFromStat(name, st, &uncertain);
+    if(uncertain) {
+        // GIO would sniff the content here; leave it to a later refinement (see Folder)
+        g_file_info_set_attribute_string(inf, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE, contentType.get());
+    }
+    else {
+        g_file_info_set_content_type(inf, contentType.get());
+    }
+    GIconPtr icon{g_content_type_get_icon(contentType.get()), false};
+    g_file_info_set_icon(inf, icon.get());
+
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_DEVICE, st.st_dev);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_UNIX_INODE, st.st_ino);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_MODE, st.st_mode);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_NLINK, st.st_nlink);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_UID, st.st_uid);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_GID, st.st_gid);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_RDEV, st.st_rdev);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_BLOCK_SIZE, st.st_blksize);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_UNIX_BLOCKS, st.st_blocks);
+
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_MODIFIED, st.st_mtim.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, st.st_mtim.tv_nsec / 1000);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_ACCESS, st.st_atim.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_ACCESS_USEC, st.st_atim.tv_nsec / 1000);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_CHANGED, st.st_ctim.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_CHANGED_USEC, st.st_ctim.tv_nsec / 1000);
+
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, canAccess(st, R_OK));
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, canAccess(st, W_OK));
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE, canAccess(st, X_OK));
+    // a file in a sticky directory can only be removed by the owner of the file or the directory
+    bool canDelete = dirWritable_
+                     && (!(dirStat_.st_mode & S_ISVTX) || uid_ == 0 || st.st_uid == uid_ || dirStat_.st_uid == uid_);
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, canDelete);
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, canDelete);
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, canDelete);
+
+    // the same format as the GIO local file backend, so that both can be compared
+    CStrPtr fsId{g_strdup_printf("l%" G_GUINT64_FORMAT, static_cast<guint64>(st.st_dev))};
+    g_file_info_set_attribute_string(inf, G_FILE_ATTRIBUTE_ID_FILESYSTEM, fsId.get());
+
+    // emblems and "metadata::trust" are kept by gvfs, and read by queryMetadata() if needed
+    if(hasMetadataStore()) {
+        g_file_info_set_attribute_boolean(inf, metadataPendingAttrib, true);
+    }
+    return info;
+}
+
+void NativeFileInfoQuery::queryMetadata(const char* name, GFileInfo* inf, GCancellable* cancellable) const {
+    auto path = CStrPtr{g_build_filename(dirPath_.c_str(), name, nullptr)};
+    GFilePtr gf{g_file_new_for_path(path.get()), false};
+    // like GIO, a file whose metadata cannot be read is shown without it
+    GFileInfoPtr meta{g_file_query_info(gf.get(), "metadata::emblems,metadata::trust", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                        cancellable, nullptr), false};
+    if(meta) {
+        copyMetadata(meta.get(), inf);
+    }
+    g_file_info_remove_attribute(inf, metadataPendingAttrib);
+}
+
+
+NativeDirEnumerator::NativeDirEnumerator(const char* dirPath):
+    fd_{open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)},
+    buf_(64 * 1024),
+    bufLen_{0},
+    bufPos_{0},
+    dirPath_{dirPath} {
+}
+
+NativeDirEnumerator::~NativeDirEnumerator() {
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+const char* NativeDirEnumerator::next(GErrorPtr& err) {
+    if(fd_ < 0) {
+        return nullptr;
+    }
+    for(;;) {
+        if(bufPos_ >= bufLen_) {
+            long len = syscall(SYS_getdents64, fd_, buf_.data(), buf_.size());
+            if(len < 0) {
+                int errsv = errno;
+                if(errsv == EINTR) {
+                    continue;
+                }
+                err = errorFromErrno(errsv, "Error when enumerating directory “%1”: %2", dirPath_);
+                return nullptr;
+            }
+            if(len == 0) { // end of directory
+                return nullptr;
+            }
+            bufLen_ = len;
+            bufPos_ = 0;
+        }
+        auto ent = reinterpret_cast<LinuxDirent64*>(buf_.data() + bufPos_);
+        bufPos_ += ent->d_reclen;
+        const char* name = ent->d_name;
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        return name;
+    }
+}
+
+} // namespace Fm
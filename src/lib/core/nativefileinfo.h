@@ -0,0 +1,90 @@
+#ifndef FM2_NATIVEFILEINFO_H
+#define FM2_NATIVEFILEINFO_H
+
+#include "../libfmqtglobals.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include "gioptrs.h"
+
+namespace Fm {
+
+/*
+ * Fast path for native directories.
+ *
+ * NativeFileInfoQuery builds GFileInfo objects for the children of a directory
+ * directly from statx() (or fstatat()) relative to the directory fd, without going
+ * through the GIO local file backend. It fills the attributes that FileInfo and the
+ * views read (see defaultGFileInfoQueryAttribs) but never sniffs file contents:
+ * the content type is guessed from the file name only. When the guess is uncertain,
+ * only "standard::fast-content-type" is set and FileInfo::isMimeTypeGuessed() is true.
+ *
+ * The gvfs metadata ("metadata::emblems", "metadata::trust") is not read by query(), since
+ * it costs a lookup in the metadata store per file. Where gvfs keeps metadata, the infos
+ * are marked so that FileInfo::isMetadataPending() is true, and queryMetadata() reads it
+ * for the files which need it, the ones being shown (see Folder::refineFileInfo()).
+ */
+class NativeFileInfoQuery {
+public:
+    // dirFd is not owned by the query and should remain open while it is used.
+    explicit NativeFileInfoQuery(int dirFd, const char* dirPath);
+
+    GFileInfoPtr query(const char* name, GErrorPtr& err) const;
+
+    // adds the gvfs metadata of the child name to inf, an info returned by query()
+    void queryMetadata(const char* name, GFileInfo* inf, GCancellable* cancellable) const;
+
+private:
+    bool canAccess(const struct stat& st, int bits) const;
+
+    void loadHiddenNames();
+
+private:
+    int dirFd_;
+    std::string dirPath_;
+    struct stat dirStat_;
+    bool dirWritable_;
+    uid_t uid_;
+    gid_t gid_;
+    std::vector<gid_t> groups_;
+    std::unordered_set<std::string> hiddenNames_; // names listed in the ".hidden" file
+};
+
+/*
+ * Reads the entries of a native directory with getdents64() in large chunks.
+ * "." and ".." are skipped.
+ */
+class NativeDirEnumerator {
+public:
+    explicit NativeDirEnumerator(const char* dirPath);
+
+    ~NativeDirEnumerator();
+
+    NativeDirEnumerator(const NativeDirEnumerator& other) = delete;
+
+    NativeDirEnumerator& operator = (const NativeDirEnumerator& other) = delete;
+
+    bool isOpen() const {
+        return fd_ >= 0;
+    }
+
+    int fd() const {
+        return fd_;
+    }
+
+    // returns nullptr at the end of the directory or on error (err is set then)
+    const char* next(GErrorPtr& err);
+
+private:
+    int fd_;
+    std::vector<char> buf_;
+    size_t bufLen_;
+    size_t bufPos_;
+    std::string dirPath_;
+};
+
+} // namespace Fm
+
+#endif // FM2_NATIVEFILEINFO_H
@@ -0,0 +1,119 @@
+#ifndef FM2_PATHQUEUE_H
+#define FM2_PATHQUEUE_H
+
+#include "../libfmqtglobals.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "filepath.h"
+
+namespace Fm {
+
+/*
+ * An insertion-ordered set of file paths with O(1) lookup, insertion and removal.
+ * Each path is identified by a string key given by the caller (Folder uses the basename),
+ * so no GFile comparison is needed. Removed entries are only marked and are dropped when
+ * the queue is compacted, taken or filtered.
+ */
+class PathQueue {
+public:
+    PathQueue(): removedCount_{0} {
+    }
+
+    bool empty() const {
+        return index_.empty();
+    }
+
+    size_t size() const {
+        return index_.size();
+    }
+
+    bool contains(const std::string& key) const {
+        return index_.find(key) != index_.cend();
+    }
+
+    // returns false if the key is already queued
+    bool insert(const std::string& key, const FilePath& path) {
+        if(!index_.emplace(key, entries_.size()).second) {
+            return false;
+        }
+        entries_.push_back(Entry{key, path, false});
+        return true;
+    }
+
+    // returns false if the key is not queued
+    bool remove(const std::string& key) {
+        auto it = index_.find(key);
+        if(it == index_.end()) {
+            return false;
+        }
+        entries_[it->second].removed = true;
+        index_.erase(it);
+        ++removedCount_;
+        if(removedCount_ > 64 && removedCount_ > entries_.size() / 2) {
+            compact();
+        }
+        return true;
+    }
+
+    void clear() {
+        entries_.clear();
+        index_.clear();
+        removedCount_ = 0;
+    }
+
+    // appends the queued paths to the list in the order of insertion and clears the queue
+    void takeAll(FilePathList& paths) {
+        paths.reserve(paths.size() + size());
+        for(auto& entry: entries_) {
+            if(!entry.removed) {
+                paths.push_back(std::move(entry.path));
+            }
+        }
+        clear();
+    }
+
+    // removes the entries for which pred(key, path) returns true, in the order of insertion
+    template <typename Pred>
+    void removeIf(Pred pred) {
+        for(auto& entry: entries_) {
+            if(!entry.removed && pred(entry.key, entry.path)) {
+                entry.removed = true;
+                index_.erase(entry.key);
+                ++removedCount_;
+            }
+        }
+        compact();
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        FilePath path;
+        bool removed;
+    };
+
+    void compact() {
+        size_t n = 0;
+        for(auto& entry: entries_) {
+            if(!entry.removed) {
+                index_[entry.key] = n;
+                if(&entries_[n] != &entry) {
+                    entries_[n] = std::move(entry);
+                }
+                ++n;
+            }
+        }
+        entries_.erase(entries_.begin() + n, entries_.end());
+        removedCount_ = 0;
+    }
+
+private:
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> index_;
+    size_t removedCount_;
+};
+
+} // namespace Fm
+
+#endif // FM2_PATHQUEUE_H
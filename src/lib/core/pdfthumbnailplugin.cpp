@@ -0,0 +1,55 @@
+#ifdef HAVE_POPPLER
+
+#include "pdfthumbnailplugin.h"
+#include <poppler-qt5.h>
+#include <QVariant>
+#include <cstring>
+#include <memory>
+
+namespace Fm {
+
+// polled by poppler while it renders the page
+static bool shouldAbortRender(const QVariant& payload) {
+    auto cancellable = static_cast<GCancellable*>(payload.value<void*>());
+    return g_cancellable_is_cancelled(cancellable);
+}
+
+bool PdfThumbnailPlugin::supports(const char* mimeType) const {
+    return strcmp(mimeType, "application/pdf") == 0;
+}
+
+QImage PdfThumbnailPlugin::generate(const FilePath& path, int size, GCancellable* cancellable) const {
+    auto localPath = path.localPath();
+    if(!localPath) {
+        return QImage();
+    }
+    std::unique_ptr<Poppler::Document> doc{Poppler::Document::load(QString::fromLocal8Bit(localPath.get()))};
+    if(!doc || doc->isLocked() || doc->numPages() == 0 || g_cancellable_is_cancelled(cancellable)) {
+        return QImage();
+    }
+    doc->setRenderHint(Poppler::Document::Antialiasing, true);
+    doc->setRenderHint(Poppler::Document::TextAntialiasing, true);
+    std::unique_ptr<Poppler::Page> page{doc->page(0)};
+    if(!page) {
+        return QImage();
+    }
+
+    // the page size is in points, 72 per inch
+    QSizeF pageSize = page->pageSizeF();
+    qreal longSide = qMax(pageSize.width(), pageSize.height());
+    if(longSide <= 0) {
+        return QImage();
+    }
+    qreal dpi = size * 72.0 / longSide;
+    QImage image = page->renderToImage(dpi, dpi, -1, -1, -1, -1, Poppler::Page::Rotate0,
+                                       nullptr, nullptr, shouldAbortRender,
+                                       QVariant::fromValue(static_cast<void*>(cancellable)));
+    if(g_cancellable_is_cancelled(cancellable)) { // the image is incomplete
+        return QImage();
+    }
+    return image;
+}
+
+} // namespace Fm
+
+#endif // HAVE_POPPLER
@@ -0,0 +1,18 @@
+#ifndef FM2_PDFTHUMBNAILPLUGIN_H
+#define FM2_PDFTHUMBNAILPLUGIN_H
+
+#include "thumbnailplugin.h"
+
+namespace Fm {
+
+// renders the first page of local PDF documents with poppler-qt5, only built with HAVE_POPPLER
+class PdfThumbnailPlugin: public ThumbnailPlugin {
+public:
+    bool supports(const char* mimeType) const override;
+
+    QImage generate(const FilePath& path, int size, GCancellable* cancellable) const override;
+};
+
+} // namespace Fm
+
+#endif // FM2_PDFTHUMBNAILPLUGIN_H
@@ -0,0 +1,122 @@
+#include "thumbnailcache.h"
+
+namespace Fm {
+
+// enough for about 500 thumbnails of 128x128 pixels
+static const size_t defaultMaxSize = 32 * 1024 * 1024;
+
+ThumbnailCache::ThumbnailCache():
+    maxSize_{defaultMaxSize},
+    totalSize_{0},
+    hits_{0},
+    misses_{0} {
+}
+
+// static
+ThumbnailCache* ThumbnailCache::globalInstance() {
+    // never deleted, thumbnail jobs may still use it at exit
+    static ThumbnailCache* instance = new ThumbnailCache();
+    return instance;
+}
+
+// static
+ThumbnailCache::Key ThumbnailCache::makeKey(const FileInfo& file, int size) {
+    auto uri = file.path().uri();
+    return Key{uri ? std::string{uri.get()} : std::string{}, file.mtime(), size};
+}
+
+// static
+size_t ThumbnailCache::imageCost(const QImage& image) {
+    return size_t(image.bytesPerLine()) * image.height();
+}
+
+QImage ThumbnailCache::find(const FileInfo& file, int size) {
+    auto key = makeKey(file, size);
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = index_.find(key);
+    if(it == index_.end()) {
+        ++misses_;
+        return QImage();
+    }
+    ++hits_;
+    // mark it as the most recently used
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->image;
+}
+
+void ThumbnailCache::insert(const FileInfo& file, int size, const QImage& image) {
+    if(image.isNull()) {
+        return;
+    }
+    auto key = makeKey(file, size);
+    size_t cost = imageCost(image);
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(cost > maxSize_) {
+        return;
+    }
+    auto it = index_.find(key);
+    if(it != index_.end()) {
+        erase(it->second);
+    }
+    entries_.push_front(Entry{key, image, cost});
+    index_.emplace(std::move(key), entries_.begin());
+    totalSize_ += cost;
+    trim();
+}
+
+void ThumbnailCache::remove(const FileInfo& file, int size) {
+    auto key = makeKey(file, size);
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = index_.find(key);
+    if(it != index_.end()) {
+        erase(it->second);
+    }
+}
+
+void ThumbnailCache::clear() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    index_.clear();
+    entries_.clear();
+    totalSize_ = 0;
+}
+
+size_t ThumbnailCache::maxSize() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxSize_;
+}
+
+void ThumbnailCache::setMaxSize(size_t maxSize) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    maxSize_ = maxSize;
+    trim();
+}
+
+ThumbnailCache::Stats ThumbnailCache::stats() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.count = entries_.size();
+    stats.totalSize = totalSize_;
+    return stats;
+}
+
+void ThumbnailCache::resetStats() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    hits_ = 0;
+    misses_ = 0;
+}
+
+void ThumbnailCache::erase(std::list<Entry>::iterator it) {
+    totalSize_ -= it->cost;
+    index_.erase(it->key);
+    entries_.erase(it);
+}
+
+void ThumbnailCache::trim() {
+    while(totalSize_ > maxSize_ && !entries_.empty()) {
+        erase(std::prev(entries_.end()));
+    }
+}
+
+} // namespace Fm
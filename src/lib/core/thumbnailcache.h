@@ -0,0 +1,96 @@
+#ifndef FM2_THUMBNAILCACHE_H
+#define FM2_THUMBNAILCACHE_H
+
+#include "../libfmqtglobals.h"
+#include <QImage>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "fileinfo.h"
+
+namespace Fm {
+
+/*
+ * A process-wide, memory-bounded cache of the loaded thumbnails, shared by all FolderModels.
+ *
+ * Thumbnails are keyed by the URI and mtime of the file and the thumbnail size, so a changed
+ * file is never served an old thumbnail. When the images exceed the budget, the least
+ * recently used ones are dropped. It may be used from any thread.
+ */
+class LIBFM_QT_API ThumbnailCache {
+public:
+    struct Stats {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        size_t count;      // number of cached thumbnails
+        size_t totalSize;  // bytes used by the cached thumbnails
+    };
+
+    static ThumbnailCache* globalInstance();
+
+    // returns a null image if the thumbnail is not cached
+    QImage find(const FileInfo& file, int size);
+
+    void insert(const FileInfo& file, int size, const QImage& image);
+
+    void remove(const FileInfo& file, int size);
+
+    void clear();
+
+    size_t maxSize() const;
+
+    // in bytes, 0 disables the cache
+    void setMaxSize(size_t maxSize);
+
+    Stats stats() const;
+
+    void resetStats();
+
+private:
+    explicit ThumbnailCache();
+
+    struct Key {
+        std::string uri;
+        quint64 mtime;
+        int size;
+
+        bool operator==(const Key& other) const {
+            return mtime == other.mtime && size == other.size && uri == other.uri;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.uri) ^ std::hash<quint64>()(key.mtime) ^ std::hash<int>()(key.size);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        QImage image;
+        size_t cost;
+    };
+
+    static Key makeKey(const FileInfo& file, int size);
+
+    static size_t imageCost(const QImage& image);
+
+    // with mutex_ locked
+    void erase(std::list<Entry>::iterator it);
+    void trim();
+
+private:
+    std::list<Entry> entries_; // the most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    size_t maxSize_;
+    size_t totalSize_;
+    std::uint64_t hits_;
+    std::uint64_t misses_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILCACHE_H
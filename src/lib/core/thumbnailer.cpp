@@ -1,15 +1,27 @@
 #include "thumbnailer.h"
 #include "mimetype.h"
+#include "gioptrs.h"
 #include <string>
 #include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 namespace Fm {
 
 std::mutex Thumbnailer::mutex_;
 std::vector<std::shared_ptr<Thumbnailer>> Thumbnailer::allThumbnailers_;
 
+std::mutex Thumbnailer::processMutex_;
+std::deque<Thumbnailer::Process*> Thumbnailer::queuedProcesses_;
+int Thumbnailer::runningProcesses_ = 0;
+int Thumbnailer::maxProcesses_ = 2;
+int Thumbnailer::timeout_ = 20;
+
 Thumbnailer::Thumbnailer(const char* id, GKeyFile* kf):
     id_{g_strdup(id)},
     try_exec_{g_key_file_get_string(kf, "Thumbnailer Entry", "TryExec", nullptr)},
@@ -69,12 +81,154 @@ CStrPtr Thumbnailer::commandForUri(const char* uri, const char* output_file, gui
     return nullptr;
 }
 
-bool Thumbnailer::run(const char* uri, const char* output_file, int size) const {
+// called in the child process before exec()
+static void setProcessGroup(gpointer /*user_data*/) {
+    // so that the children of the thumbnailer can be killed with it
+    setpgid(0, 0);
+}
+
+// a thumbnailer process, queued or running
+struct Thumbnailer::Process {
+    Process(char** argv, GCancellable* cancellable, std::function<void (Result)> done):
+        args{argv},
+        cancellable{cancellable},
+        done{std::move(done)},
+        pid{0},
+        timeoutSource{0},
+        cancelledHandler{0},
+        timedOut{false} {
+    }
+
+    CStrArrayPtr args;
+    GCancellablePtr cancellable;
+    std::function<void (Result)> done;
+    GPid pid;
+    guint timeoutSource;
+    gulong cancelledHandler;
+    bool timedOut;
+};
+
+void Thumbnailer::start(const char* uri, const char* output_file, int size, GCancellable* cancellable,
+                        std::function<void (Result)> done) const {
     auto cmd = commandForUri(uri, output_file, size);
     qDebug() << cmd.get();
-    int status;
-    bool ret = g_spawn_command_line_sync(cmd.get(), nullptr, nullptr, &status, nullptr);
-    return ret && status == 0;
+    char** argv = nullptr;
+    if(!cmd || !g_shell_parse_argv(cmd.get(), nullptr, &argv, nullptr)) {
+        done(Result::FAILED);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{processMutex_};
+        queuedProcesses_.push_back(new Process{argv, cancellable, std::move(done)});
+    }
+    startQueuedProcesses();
+}
+
+// starts the queued processes while there are free slots; the ones cancelled meanwhile are skipped
+void Thumbnailer::startQueuedProcesses() {
+    for(;;) {
+        Process* process;
+        {
+            std::lock_guard<std::mutex> lock{processMutex_};
+            if(queuedProcesses_.empty() || runningProcesses_ >= maxProcesses_) {
+                return;
+            }
+            process = queuedProcesses_.front();
+            queuedProcesses_.pop_front();
+            ++runningProcesses_;
+        }
+        Result result = Result::CANCELLED;
+        if(!g_cancellable_is_cancelled(process->cancellable.get())) {
+            if(g_spawn_async(nullptr, process->args.get(), nullptr, GSpawnFlags(G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD),
+                             setProcessGroup, nullptr, &process->pid, nullptr)) {
+                // nobody waits for it: onProcessExited() is called by the main loop
+                g_child_watch_add(process->pid, GChildWatchFunc(onProcessExited), process);
+                int seconds = timeout();
+                if(seconds > 0) {
+                    process->timeoutSource = g_timeout_add_seconds(seconds, GSourceFunc(onProcessTimeout), process);
+                }
+                if(process->cancellable) {
+                    process->cancelledHandler = g_cancellable_connect(process->cancellable.get(), G_CALLBACK(onProcessCancelled),
+                                                                      process, nullptr);
+                }
+                continue;
+            }
+            result = Result::FAILED;
+        }
+        {
+            std::lock_guard<std::mutex> lock{processMutex_};
+            --runningProcesses_;
+        }
+        process->done(result);
+        delete process;
+    }
+}
+
+void Thumbnailer::onProcessExited(GPid pid, gint status, Process* process) {
+    g_spawn_close_pid(pid);
+    if(process->timeoutSource) {
+        g_source_remove(process->timeoutSource);
+    }
+    if(process->cancelledHandler) {
+        // waits for the handler if it is running in another thread
+        g_cancellable_disconnect(process->cancellable.get(), process->cancelledHandler);
+    }
+    Result result;
+    if(process->timedOut) {
+        result = Result::TIMED_OUT;
+    }
+    else if(g_cancellable_is_cancelled(process->cancellable.get())) {
+        result = Result::CANCELLED;
+    }
+    else {
+        result = WIFEXITED(status) && WEXITSTATUS(status) == 0 ? Result::SUCCEEDED : Result::FAILED;
+    }
+    {
+        std::lock_guard<std::mutex> lock{processMutex_};
+        --runningProcesses_;
+    }
+    process->done(result);
+    delete process;
+    startQueuedProcesses();
+}
+
+static void killProcess(GPid pid) {
+    kill(-pid, SIGKILL);
+    kill(pid, SIGKILL); // in case it was not in its own group yet
+}
+
+gboolean Thumbnailer::onProcessTimeout(Process* process) {
+    process->timeoutSource = 0;
+    process->timedOut = true;
+    killProcess(process->pid); // onProcessExited() follows
+    return G_SOURCE_REMOVE;
+}
+
+void Thumbnailer::onProcessCancelled(GCancellable* /*cancellable*/, Process* process) {
+    killProcess(process->pid);
+}
+
+void Thumbnailer::setMaxProcesses(int count) {
+    {
+        std::lock_guard<std::mutex> lock{processMutex_};
+        maxProcesses_ = std::max(count, 1);
+    }
+    startQueuedProcesses();
+}
+
+int Thumbnailer::maxProcesses() {
+    std::lock_guard<std::mutex> lock{processMutex_};
+    return maxProcesses_;
+}
+
+void Thumbnailer::setTimeout(int seconds) {
+    std::lock_guard<std::mutex> lock{processMutex_};
+    timeout_ = std::max(seconds, 0);
+}
+
+int Thumbnailer::timeout() {
+    std::lock_guard<std::mutex> lock{processMutex_};
+    return timeout_;
 }
 
 static void find_thumbnailers_in_data_dir(std::unordered_map<std::string, const char*>& hash, const char* data_dir) {
@@ -5,8 +5,11 @@
 #include "cstrptr.h"
 #include <unordered_map>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <functional>
+#include <gio/gio.h>
 
 namespace Fm {
 
@@ -14,14 +17,37 @@ class MimeType;
 
 class LIBFM_QT_API Thumbnailer {
 public:
+    enum class Result {
+        SUCCEEDED,
+        FAILED,
+        TIMED_OUT,
+        CANCELLED
+    };
+
     explicit Thumbnailer(const char *id, GKeyFile *kf);
 
     CStrPtr commandForUri(const char* uri, const char* output_file, guint size) const;
 
-    bool run(const char* uri, const char* output_file, int size) const;
+    // starts the thumbnailer without waiting for it, or queues it until a process slot is free.
+    // Must be called in the thread of the default main context (the GUI thread), where done is
+    // called once the process has exited. The process and its children are killed when it times
+    // out or the cancellable is cancelled; a queued one is not started then.
+    void start(const char* uri, const char* output_file, int size, GCancellable* cancellable,
+               std::function<void (Result)> done) const;
 
     static void loadAll();
 
+    // the number of thumbnailer processes which may run at once in the whole application;
+    // called in the GUI thread like start()
+    static void setMaxProcesses(int count);
+
+    static int maxProcesses();
+
+    // in seconds, 0 means no timeout
+    static void setTimeout(int seconds);
+
+    static int timeout();
+
 private:
     CStrPtr id_;
     CStrPtr try_exec_; /* FIXME: is this useful? */
@@ -30,6 +56,19 @@ private:
 
     static std::mutex mutex_;
     static std::vector<std::shared_ptr<Thumbnailer>> allThumbnailers_;
+
+    struct Process;
+
+    static void startQueuedProcesses();
+    static void onProcessExited(GPid pid, gint status, Process* process);
+    static gboolean onProcessTimeout(Process* process);
+    static void onProcessCancelled(GCancellable* cancellable, Process* process);
+
+    static std::mutex processMutex_;
+    static std::deque<Process*> queuedProcesses_;
+    static int runningProcesses_;
+    static int maxProcesses_;
+    static int timeout_;
 };
 
 } // namespace Fm
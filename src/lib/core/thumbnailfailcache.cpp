@@ -0,0 +1,104 @@
+#include "thumbnailfailcache.h"
+#include <QImage>
+#include <QImageReader>
+#include <QString>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <cstring>
+
+namespace Fm {
+
+static const size_t keyLength = 32;
+static const quint64 unknownMtime = quint64(-1);
+
+ThumbnailFailCache::ThumbnailFailCache():
+    dir_{g_get_user_cache_dir()},
+    loaded_{false} {
+    // thumbnails/fail/{application name-version}, as in the freedesktop spec
+    dir_ += "/thumbnails/fail/panda-files-1.0";
+}
+
+// static
+ThumbnailFailCache* ThumbnailFailCache::globalInstance() {
+    // never deleted, thumbnail jobs may still use it at exit
+    static ThumbnailFailCache* instance = new ThumbnailFailCache();
+    return instance;
+}
+
+void ThumbnailFailCache::load() {
+    loaded_ = true;
+    GDir* dir = g_dir_open(dir_.c_str(), 0, nullptr);
+    if(dir) {
+        const char* name;
+        while((name = g_dir_read_name(dir)) != nullptr) {
+            // {md5 of uri}.png
+            if(strlen(name) == keyLength + 4 && g_str_has_suffix(name, ".png")) {
+                mtimes_.emplace(std::string{name, keyLength}, unknownMtime);
+            }
+        }
+        g_dir_close(dir);
+    }
+}
+
+std::string ThumbnailFailCache::recordPath(const std::string& key) const {
+    std::string path = dir_;
+    path += '/';
+    path += key;
+    path += ".png";
+    return path;
+}
+
+bool ThumbnailFailCache::contains(const char* key, quint64 mtime) {
+    std::string keyStr{key, keyLength};
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!loaded_) {
+        load();
+    }
+    auto it = mtimes_.find(keyStr);
+    if(it == mtimes_.end()) {
+        return false;
+    }
+    if(it->second == unknownMtime) {
+        // only the text chunks are read, not the image
+        QImageReader reader{QString::fromLocal8Bit(recordPath(keyStr).c_str()), "PNG"};
+        bool ok;
+        quint64 recordMtime = reader.text(QStringLiteral("Thumb::MTime")).toULongLong(&ok);
+        if(!ok) {
+            mtimes_.erase(it);
+            return false;
+        }
+        it->second = recordMtime;
+    }
+    return it->second == mtime;
+}
+
+void ThumbnailFailCache::add(const char* key, const char* uri, quint64 mtime) {
+    std::string keyStr{key, keyLength};
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!loaded_) {
+        load();
+    }
+    mtimes_[keyStr] = mtime;
+
+    g_mkdir_with_parents(dir_.c_str(), 0700);
+    QImage record{1, 1, QImage::Format_ARGB32};
+    record.fill(Qt::transparent);
+    record.setText(QStringLiteral("Thumb::MTime"), QString::number(mtime));
+    record.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+    record.save(QString::fromLocal8Bit(recordPath(keyStr).c_str()), "PNG");
+}
+
+void ThumbnailFailCache::remove(const char* key) {
+    std::string keyStr{key, keyLength};
+    std::lock_guard<std::mutex> lock{mutex_};
+    if(!loaded_) {
+        load();
+    }
+    auto it = mtimes_.find(keyStr);
+    if(it != mtimes_.end()) {
+        mtimes_.erase(it);
+        g_unlink(recordPath(keyStr).c_str());
+    }
+}
+
+} // namespace Fm
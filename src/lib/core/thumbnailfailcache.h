@@ -0,0 +1,51 @@
+#ifndef FM2_THUMBNAILFAILCACHE_H
+#define FM2_THUMBNAILFAILCACHE_H
+
+#include "../libfmqtglobals.h"
+#include <QtGlobal>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Fm {
+
+/*
+ * Remembers the files no thumbnail could be made for, so that corrupt images and files
+ * unsupported by every thumbnailer are not decoded again on every visit.
+ *
+ * Failures are recorded as the freedesktop thumbnail spec describes: an empty PNG with the
+ * Thumb::URI and Thumb::MTime of the file in $XDG_CACHE_HOME/thumbnails/fail/panda-files-1.0,
+ * named after the md5 of the file URI. The names in that directory are listed once and kept
+ * in memory, so a lookup is a hash lookup; the mtime of a record on disk is only read the
+ * first time it is looked up. A failure is forgotten once the file is modified.
+ * It may be used from any thread.
+ */
+class LIBFM_QT_API ThumbnailFailCache {
+public:
+    static ThumbnailFailCache* globalInstance();
+
+    // key is the md5 of the file URI in hex, as in the names of the thumbnails
+    bool contains(const char* key, quint64 mtime);
+
+    void add(const char* key, const char* uri, quint64 mtime);
+
+    void remove(const char* key);
+
+private:
+    explicit ThumbnailFailCache();
+
+    // with mutex_ locked
+    void load();
+    std::string recordPath(const std::string& key) const;
+
+private:
+    std::string dir_;
+    bool loaded_;
+    // the mtime of each failed file, or unknownMtime for a record on disk not read yet
+    std::unordered_map<std::string, quint64> mtimes_;
+    std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILFAILCACHE_H
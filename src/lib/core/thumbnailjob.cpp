@@ -4,22 +4,33 @@
 #include <algorithm>
 #include <libexif/exif-loader.h>
 #include <QImageReader>
+#include <QBuffer>
 #include <QDir>
+#include <QPainter>
 #include "thumbnailer.h"
+#include "thumbnailplugin.h"
+#include "jobexecutor.h"
+#include "thumbnailcache.h"
+#include "thumbnailpack.h"
+#include "thumbnailfailcache.h"
 
 #include "legacy/fm-config.h"
 
 namespace Fm {
 
-QThreadPool* ThumbnailJob::threadPool_ = nullptr;
-
+int ThumbnailJob::workerCount_ = 0;
+bool ThumbnailJob::useThumbnailPacks_ = false;
 bool ThumbnailJob::localFilesOnly_ = true;
 int ThumbnailJob::maxThumbnailFileSize_ = 0;
 
 ThumbnailJob::ThumbnailJob(FileInfoList files, int size):
     files_{std::move(files)},
     size_{size},
+    thumbnailersRun_{false},
+    thumbnailersSucceeded_{false},
+    deferred_{false},
     md5Calc_{g_checksum_new(G_CHECKSUM_MD5)} {
+    setExecutionClass(ExecutionClass::THUMBNAIL);
 }
 
 ThumbnailJob::~ThumbnailJob() {
@@ -27,97 +38,206 @@ ThumbnailJob::~ThumbnailJob() {
     // qDebug("delete  ThumbnailJob");
 }
 
+// static
+const ThumbnailJob::ThumbnailDirs& ThumbnailJob::thumbnailDirs() {
+    // thumbnails are stored in $XDG_CACHE_HOME/thumbnails/large|normal|fail,
+    // which does not change while the program runs
+    static const ThumbnailDirs dirs = [] {
+        ThumbnailDirs dirs;
+        QString root{QString::fromUtf8(g_get_user_cache_dir())};
+        root += QLatin1String("/thumbnails/");
+        dirs.rootPath = FilePath::fromLocalPath(root.toLocal8Bit().constData());
+        dirs.normal = root + QLatin1String("normal/");
+        dirs.large = root + QLatin1String("large/");
+        return dirs;
+    }();
+    return dirs;
+}
+
+void ThumbnailJob::prepareLookups(const FileInfoList& files, std::vector<Lookup>& lookups) {
+    lookups.clear();
+    lookups.resize(files.size());
+    const FilePath& thumbnailRoot = thumbnailDirs().rootPath;
+    // the files of a job are mostly in the same directory
+    FilePath lastDirPath;
+    bool lastDirInThumbnailRoot = false;
+    for(size_t i = 0; i < files.size(); ++i) {
+        auto& file = files[i];
+        auto& lookup = lookups[i];
+        if(!file->canThumbnail()) {
+            continue;
+        }
+
+        // don't make thumbnails for files inside the thumbnail directory
+        const FilePath& dirPath = file->dirPath();
+        if(!lastDirPath || dirPath != lastDirPath) {
+            lastDirPath = dirPath;
+            lastDirInThumbnailRoot = thumbnailRoot.isParentOf(dirPath);
+        }
+        if(lastDirInThumbnailRoot) {
+            continue;
+        }
+
+        if(file->isSymlink()) {
+            // use the symlink target in the name to update the thumbnail
+            // if the file is changed to a symlink with the same time stamp
+            auto& target = file->target();
+            if(!target.empty()) {
+                lookup.uri = FilePath::fromLocalPath(target.c_str()).uri();
+            }
+        }
+        if(!lookup.uri) {
+            lookup.uri = file->path().uri();
+        }
+        if(!lookup.uri) {
+            continue;
+        }
+
+        // base name of the thumbnail => {md5 of uri}.png
+        g_checksum_update(md5Calc_, reinterpret_cast<const unsigned char*>(lookup.uri.get()), -1);
+        memcpy(lookup.name, g_checksum_get_string(md5Calc_), 32);
+        memcpy(lookup.name + 32, ".png", 5);
+        g_checksum_reset(md5Calc_); // reset the checksum calculator for next use
+        lookup.valid = true;
+    }
+}
+
 void ThumbnailJob::exec() {
-    for(auto& file: files_) {
+    // hash the URIs of all the files before any I/O
+    std::vector<Lookup> lookups;
+    prepareLookups(files_, lookups);
+    for(size_t i = 0; i < files_.size(); ++i) {
+        auto& file = files_[i];
         if(isCancelled()) {
             break;
         }
-        auto image = loadForFile(file);
-        Q_EMIT thumbnailLoaded(file, size_, image);
+        auto image = loadForFile(file, lookups[i]);
+        if(isCancelled()) {
+            // the image may be incomplete, and a failure would not be retried
+            break;
+        }
+        if(deferred_) { // see externalRequests()
+            continue;
+        }
+        // precompute the faded variant here rather than when it is painted
+        QImage transparentImage;
+        if(!image.isNull() && needsTransparentVariant(size_)) {
+            transparentImage = makeTransparent(image);
+        }
+        Q_EMIT thumbnailLoaded(file, size_, image, transparentImage);
         results_.emplace_back(std::move(image));
     }
 }
 
-QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
-    // FIXME: should we set a limit here? Otherwise if len is too large, we can run out of memory.
-    std::unique_ptr<unsigned char[]> buffer{new unsigned char[len]}; // allocate enough buffer
-    unsigned char* pbuffer = buffer.get();
+QByteArray ThumbnailJob::readStream(GInputStream* stream, size_t len) {
+    QByteArray buffer;
+    // the caller limits len to maxThumbnailFileSize()
+    buffer.resize(len);
+    char* pbuffer = buffer.data();
     size_t totalReadSize = 0;
     while(!isCancelled() && totalReadSize < len) {
-        size_t bytesToRead = totalReadSize + 4096 > len ? len - totalReadSize : 4096;
-        gssize readSize = g_input_stream_read(stream, pbuffer, bytesToRead, cancellable_.get(), nullptr);
+        size_t bytesToRead = totalReadSize + 65536 > len ? len - totalReadSize : 65536;
+        gssize readSize = g_input_stream_read(stream, pbuffer, bytesToRead, cancellable().get(), nullptr);
         if(readSize == 0) { // end of file
             break;
         }
         else if(readSize == -1) { // error
-            return QImage();
+            return QByteArray();
         }
         totalReadSize += readSize;
         pbuffer += readSize;
     }
-    QImage image;
-    image.loadFromData(buffer.get(), totalReadSize);
-    return image;
+    buffer.truncate(totalReadSize);
+    return buffer;
 }
 
-QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file) {
-    if(!file->canThumbnail()) {
-        return QImage();
+QImage ThumbnailJob::readScaledImage(QImageReader& reader, int targetSize) {
+    reader.setAutoTransform(false); // the EXIF orientation is applied by generateThumbnail()
+    QSize imageSize = reader.size(); // only the header is read
+    if(imageSize.width() > targetSize || imageSize.height() > targetSize) {
+        // the JPEG plugin decodes directly at about this size by scaling in the DCT,
+        // and the other formats are scaled after decoding as before
+        reader.setScaledSize(imageSize.scaled(targetSize, targetSize, Qt::KeepAspectRatio));
     }
+    return reader.read();
+}
 
-    // thumbnails are stored in $XDG_CACHE_HOME/thumbnails/large|normal|failed
-    QString thumbnailDir{QString::fromUtf8(g_get_user_cache_dir())};
-    thumbnailDir += QLatin1String("/thumbnails/");
-
-    // don't make thumbnails for files inside the thumbnail directory
-    if(FilePath::fromLocalPath(thumbnailDir.toLocal8Bit().constData()).isParentOf(file->dirPath())) {
+QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo> &file, const Lookup& lookup) {
+    deferred_ = false;
+    if(!lookup.valid) {
         return QImage();
     }
 
-    QLatin1String subdir = size_ > 128 ? QLatin1String("large") : QLatin1String("normal");
-    thumbnailDir += subdir;
-
-    // generate base name of the thumbnail  => {md5 of uri}.png
-    auto origPath = file->path();
-    CStrPtr uri;
-    if(file->isSymlink()) {
-        // use the symlink target in the name to update the thumbnail
-        // if the file is changed to a symlink with the same time stamp
-        auto target = file->target();
-        if(!target.empty()) {
-            uri = FilePath::fromLocalPath(target.c_str()).uri();
-        }
+    auto cache = ThumbnailCache::globalInstance();
+    QImage cached = cache->find(*file, size_);
+    if(!cached.isNull()) {
+        return cached;
     }
-    if(!uri) {
-        uri = origPath.uri();
-    }
-
-    char thumbnailName[32 + 5];
-    // calculate md5 hash for the uri of the original file
-    g_checksum_update(md5Calc_, reinterpret_cast<const unsigned char*>(uri.get()), -1);
-    memcpy(thumbnailName, g_checksum_get_string(md5Calc_), 32);
-    memcpy(thumbnailName + 32, ".png", 5);
-    g_checksum_reset(md5Calc_); // reset the checksum calculator for next use
 
-    QString thumbnailFilename = thumbnailDir;
-    thumbnailFilename += QLatin1Char('/');
-    thumbnailFilename += QString::fromUtf8(thumbnailName);
-    // qDebug() << "thumbnail:" << file->getName().c_str() << thumbnailFilename;
+    const char* thumbnailName = lookup.name;
+    const QString& thumbnailDir = size_ > 128 ? thumbnailDirs().large : thumbnailDirs().normal;
 
-    // try to load the thumbnail file if it exists
-    QImage thumbnail{thumbnailFilename};
-    if(thumbnail.isNull() || isThumbnailOutdated(file, thumbnail)) {
-        // the existing thumbnail cannot be loaded, generate a new one
+    // the pack of the directory serves the thumbnails of a whole view with a few reads
+    std::shared_ptr<ThumbnailPack> pack;
+    if(useThumbnailPacks_ && file->dirPath()) {
+        pack = ThumbnailPack::forDirectory(file->dirPath(), size_ > 128);
+    }
+    QImage thumbnail;
+    if(pack) {
+        thumbnail = pack->find(thumbnailName, file->mtime());
+    }
 
-        // create the thumbnail dir as needd (FIXME: Qt file I/O is slow)
-        QDir().mkpath(thumbnailDir);
+    // don't try again to make a thumbnail which could not be made for this version of the file
+    auto failCache = ThumbnailFailCache::globalInstance();
+    if(thumbnail.isNull() && failCache->contains(thumbnailName, file->mtime())) {
+        return QImage();
+    }
 
-        thumbnail = generateThumbnail(file, origPath, uri.get(), thumbnailFilename);
+    if(thumbnail.isNull()) {
+        QString thumbnailFilename;
+        thumbnailFilename.reserve(thumbnailDir.size() + 32 + 4);
+        thumbnailFilename += thumbnailDir;
+        thumbnailFilename += QLatin1String(thumbnailName);
+        // qDebug() << "thumbnail:" << file->getName().c_str() << thumbnailFilename;
+
+        // try to load the thumbnail file if it exists
+        thumbnail = QImage{thumbnailFilename};
+        if(thumbnail.isNull() || isThumbnailOutdated(file, thumbnail)) {
+            // the existing thumbnail cannot be loaded, generate a new one
+
+            // create the thumbnail dir as needd (FIXME: Qt file I/O is slow)
+            QDir().mkpath(thumbnailDir);
+
+            bool failed;
+            thumbnail = generateThumbnail(file, file->path(), lookup.uri.get(), thumbnailFilename, failed);
+            if(deferred_) {
+                return QImage();
+            }
+            if(!isCancelled()) {
+                if(failed) {
+                    failCache->add(thumbnailName, lookup.uri.get(), file->mtime());
+                }
+                else if(!thumbnail.isNull()) {
+                    // it failed with an older version of the file
+                    failCache->remove(thumbnailName);
+                }
+            }
+        }
+        if(pack && !thumbnail.isNull() && !isCancelled()) {
+            pack->add(thumbnailName, file->mtime(), thumbnail);
+        }
     }
     // resize to the size we need
     if(thumbnail.width() > size_ || thumbnail.height() > size_) {
         thumbnail = thumbnail.scaled(size_, size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
+    // the format QPainter draws without converting, so that views only have to wrap it
+    if(!thumbnail.isNull() && thumbnail.format() != QImage::Format_ARGB32_Premultiplied) {
+        thumbnail = thumbnail.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    if(!isCancelled()) { // the image may be incomplete otherwise
+        cache->insert(*file, size_, thumbnail);
+    }
     return thumbnail;
 }
 
@@ -141,7 +261,7 @@ bool ThumbnailJob::readJpegExif(GInputStream *stream, QImage& thumbnail, QMatrix
     ExifLoader* exif_loader = exif_loader_new();
     while(!isCancelled()) {
         unsigned char buf[4096];
-        gssize read_size = g_input_stream_read(stream, buf, 4096, cancellable_.get(), nullptr);
+        gssize read_size = g_input_stream_read(stream, buf, 4096, cancellable().get(), nullptr);
         if(read_size <= 0) { // EOF or error
             break;
         }
@@ -197,13 +317,15 @@ bool ThumbnailJob::readJpegExif(GInputStream *stream, QImage& thumbnail, QMatrix
     return !thumbnail.isNull();
 }
 
-QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename) {
+QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename, bool& failed) {
     QImage result;
+    failed = false;
     auto mime_type = file->mimeType();
     if(isSupportedImageType(mime_type)) {
-        GFileInputStreamPtr ins{g_file_read(origPath.gfile().get(), cancellable_.get(), nullptr), false};
+        GFileInputStreamPtr ins{g_file_read(origPath.gfile().get(), cancellable().get(), nullptr), false};
         if(!ins)
             return QImage();
+        int target_size = size_ > 128 ? 256 : 128;
         bool fromExif = false;
         QMatrix matrix;
         if(strcmp(mime_type->name(), "image/jpeg") == 0) { // if this is a jpeg file
@@ -213,16 +335,26 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             }
         }
         if(!fromExif) {  // not able to generate a thumbnail from the EXIF data
-            // load the original file and do the scaling ourselves
-            g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable_.get(), nullptr);
-            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size());
+            // load the original file, decoding it at about the size of the thumbnail
+            auto localPath = origPath.localPath();
+            if(localPath) {
+                // stream it from the file rather than from a buffer of its whole size
+                QImageReader reader{QString::fromLocal8Bit(localPath.get())};
+                result = readScaledImage(reader, target_size);
+                failed = result.isNull();
+            }
+            else if(maxThumbnailFileSize_ <= 0 || file->size() <= quint64(maxThumbnailFileSize_) * 1024) {
+                g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable().get(), nullptr);
+                QByteArray data = readStream(G_INPUT_STREAM(ins.get()), file->size());
+                QBuffer buffer{&data};
+                QImageReader reader{&buffer};
+                result = readScaledImage(reader, target_size);
+                failed = result.isNull() && data.size() == qint64(file->size()); // not a read error
+            }
         }
         g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
 
         if(!result.isNull()) { // the image is successfully loaded
-            // scale the image as needed
-            int target_size = size_ > 128 ? 256 : 128;
-
             // only scale the original image if it's too large
             if(result.width() > target_size || result.height() > target_size) {
                 result = result.scaled(target_size, target_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
@@ -241,15 +373,14 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             // qDebug() << "save thumbnail:" << thumbnailFilename;
         }
     }
-    else { // the image format is not supported, try to find an external thumbnailer
-        // try all available external thumbnailers for it until sucess
-        int target_size = size_ > 128 ? 256 : 128;
-        file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
-            if(thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size)) {
-                result = QImage(thumbnailFilename);
-            }
-            return !result.isNull(); // return true on success, and forEachThumbnailer() will stop.
-        });
+    else if(generateWithPlugin(file, origPath, uri, thumbnailFilename, result)) {
+        // made in this thread without running an external thumbnailer
+    }
+    else if(thumbnailersRun_) { // the external thumbnailers have been run for it, see setThumbnailersRun()
+        if(thumbnailersSucceeded_) {
+            result = QImage(thumbnailFilename);
+        }
+        failed = result.isNull();
 
         if(!result.isNull()) {
             // Some thumbnailers did not write the proper metadata required by the xdg spec to the output (such as evince-thumbnailer)
@@ -269,15 +400,67 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
             }
         }
     }
+    else if(!isCancelled()) { // the image format is not supported, try to find an external thumbnailer
+        ExternalRequest request;
+        file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
+            request.thumbnailers.push_back(thumbnailer);
+            return false;
+        });
+        if(request.thumbnailers.empty()) {
+            failed = true;
+        }
+        else {
+            // they are run by ThumbnailScheduler, which loads the file again in a new job after them
+            request.file = file;
+            request.uri = uri;
+            request.thumbnailFilename = thumbnailFilename.toLocal8Bit().constData();
+            request.size = size_ > 128 ? 256 : 128;
+            externalRequests_.push_back(std::move(request));
+            deferred_ = true;
+        }
+    }
     return result;
 }
 
-QThreadPool* ThumbnailJob::threadPool() {
-    if(Q_UNLIKELY(threadPool_ == nullptr)) {
-        threadPool_ = new QThreadPool();
-        threadPool_->setMaxThreadCount(1);
+// returns false if no plugin supports the file or the plugin failed with it
+bool ThumbnailJob::generateWithPlugin(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename, QImage& result) {
+    auto plugin = ThumbnailPlugin::forMimeType(file->mimeType());
+    if(!plugin) {
+        return false;
     }
-    return threadPool_;
+    int target_size = size_ > 128 ? 256 : 128;
+    result = plugin->generate(origPath, target_size, cancellable().get());
+    if(result.isNull() || isCancelled()) {
+        result = QImage();
+        return false;
+    }
+    result.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
+    result.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+    result.save(thumbnailFilename, "PNG");
+    return true;
+}
+
+// static
+QImage ThumbnailJob::makeTransparent(const QImage& image) {
+    QImage result = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QPainter painter{&result};
+    painter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+    painter.fillRect(result.rect(), QColor(0, 0, 0, 115 /* alpha 45% */));
+    painter.end();
+    return result;
+}
+
+void ThumbnailJob::setWorkerCount(int count) {
+    workerCount_ = std::max(count, 0);
+    if(workerCount_ == 0) {
+        // decoding is CPU bound, but leave some cores to the rest of the desktop
+        count = qBound(2, QThread::idealThreadCount() / 2, 4);
+    }
+    JobExecutor::globalInstance()->setMaxThreadCount(ExecutionClass::THUMBNAIL, count);
+}
+
+void ThumbnailJob::setUseThumbnailPacks(bool value) {
+    useThumbnailPacks_ = value;
 }
 
 void ThumbnailJob::setLocalFilesOnly(bool value) {
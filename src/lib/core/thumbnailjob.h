@@ -5,10 +5,17 @@
 #include "fileinfo.h"
 #include "gioptrs.h"
 #include "job.h"
-#include <QThreadPool>
+#include "cstrptr.h"
+#include <QString>
+#include <string>
+#include <vector>
+
+class QImageReader;
 
 namespace Fm {
 
+class Thumbnailer;
+
 class LIBFM_QT_API ThumbnailJob: public Job {
     Q_OBJECT
 public:
@@ -21,7 +28,19 @@ public:
         return size_;
     }
 
-    static QThreadPool* threadPool();
+    // the number of thumbnails loaded in parallel, 0 means automatic
+    static void setWorkerCount(int count);
+
+    static int workerCount() {
+        return workerCount_;
+    }
+
+    // also keep the thumbnails in a ThumbnailPack per directory
+    static void setUseThumbnailPacks(bool value);
+
+    static bool useThumbnailPacks() {
+        return useThumbnailPacks_;
+    }
 
     static void setLocalFilesOnly(bool value);
 
@@ -35,12 +54,43 @@ public:
 
     static void setMaxThumbnailFileSize(int size);
 
+    // cut files are shown with faded thumbnails in the small sizes of the compact
+    // and detailed list views only
+    static bool needsTransparentVariant(int size) {
+        return size < 48;
+    }
+
+    static QImage makeTransparent(const QImage& image);
+
     const std::vector<QImage>& results() const {
         return results_;
     }
 
+    // a file whose thumbnail can only be made by external thumbnailers, which the job does not
+    // run: it would hold its thread while they run. No thumbnailLoaded() is emitted for it.
+    struct ExternalRequest {
+        std::shared_ptr<const FileInfo> file;
+        std::string uri;
+        std::string thumbnailFilename; // where the thumbnailers write it, in the local encoding
+        int size;                      // asked to the thumbnailers
+        std::vector<std::shared_ptr<const Thumbnailer>> thumbnailers;
+    };
+
+    const std::vector<ExternalRequest>& externalRequests() const {
+        return externalRequests_;
+    }
+
+    // for a job loading again the files of external requests once their thumbnailers were run:
+    // what they made is loaded, or the failure is recorded, but they are not run again
+    void setThumbnailersRun(bool succeeded) {
+        thumbnailersRun_ = true;
+        thumbnailersSucceeded_ = succeeded;
+    }
+
 Q_SIGNALS:
-    void thumbnailLoaded(const std::shared_ptr<const FileInfo>& file, int size, QImage thumbnail);
+    // the images are premultiplied and ready to paint; transparentThumbnail is the faded
+    // variant shown for cut files, or a null image if the size does not need one
+    void thumbnailLoaded(const std::shared_ptr<const FileInfo>& file, int size, QImage thumbnail, QImage transparentThumbnail);
 
 protected:
 
@@ -48,15 +98,40 @@ protected:
 
 private:
 
+    // the thumbnail directories, computed once
+    struct ThumbnailDirs {
+        FilePath rootPath;
+        QString normal; // with a trailing '/'
+        QString large;
+    };
+
+    // what is needed to find the thumbnail of a file
+    struct Lookup {
+        Lookup(): valid{false} {}
+
+        bool valid;      // false if no thumbnail is made for the file
+        CStrPtr uri;
+        char name[32 + 5]; // {md5 of uri}.png
+    };
+
+    static const ThumbnailDirs& thumbnailDirs();
+
+    // computes the lookups of all the files in one pass
+    void prepareLookups(const FileInfoList& files, std::vector<Lookup>& lookups);
+
     bool isSupportedImageType(const std::shared_ptr<const MimeType>& mimeType) const;
 
     bool isThumbnailOutdated(const std::shared_ptr<const FileInfo>& file, const QImage& thumbnail) const;
 
-    QImage generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename);
+    QImage generateThumbnail(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename, bool& failed);
+
+    bool generateWithPlugin(const std::shared_ptr<const FileInfo>& file, const FilePath& origPath, const char* uri, const QString& thumbnailFilename, QImage& result);
 
-    QImage readImageFromStream(GInputStream* stream, size_t len);
+    QByteArray readStream(GInputStream* stream, size_t len);
 
-    QImage loadForFile(const std::shared_ptr<const FileInfo>& file);
+    QImage readScaledImage(QImageReader& reader, int targetSize);
+
+    QImage loadForFile(const std::shared_ptr<const FileInfo>& file, const Lookup& lookup);
 
     bool readJpegExif(GInputStream* stream, QImage& thumbnail, QMatrix& matrix);
 
@@ -64,11 +139,15 @@ private:
     FileInfoList files_;
     int size_;
     std::vector<QImage> results_;
-    GCancellablePtr cancellable_;
+    std::vector<ExternalRequest> externalRequests_;
+    bool thumbnailersRun_;
+    bool thumbnailersSucceeded_;
+    // set by generateThumbnail() when the file is left to external thumbnailers
+    bool deferred_;
     GChecksum* md5Calc_;
 
-    static QThreadPool* threadPool_;
-
+    static int workerCount_;
+    static bool useThumbnailPacks_;
     static bool localFilesOnly_;
     static int maxThumbnailFileSize_;
 };
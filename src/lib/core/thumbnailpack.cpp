@@ -0,0 +1,458 @@
+#include "thumbnailpack.h"
+#include <QBuffer>
+#include <QByteArray>
+#include <algorithm>
+#include <list>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctime>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "cstrptr.h"
+
+namespace Fm {
+
+namespace {
+
+struct PackHeader {
+    char magic[8];
+    quint32 byteOrder; // packs are only valid on machines of the same byte order
+    quint32 reserved;
+};
+
+struct RecordHeader {
+    quint32 magic;
+    quint32 dataSize;  // bytes of PNG data following the header
+    quint64 mtime;
+    char key[32];
+    quint32 lastSeen;  // the day it was last found or added, in days since the epoch
+    quint32 reserved;
+};
+
+const char packMagic[8] = {'F', 'M', 'T', 'P', 'A', 'C', 'K', '2'};
+const quint32 byteOrderMark = 0x01020304;
+const quint32 recordMagic = 0x54524543; // "TREC"
+const size_t keyLength = 32;
+
+const size_t maxOpenPacks = 16;
+const size_t minCompactSize = 1024 * 1024;
+// the records not found for longer are dropped, and the packs not opened for longer removed
+const quint32 maxUnusedDays = 90;
+
+quint32 today() {
+    return quint32(time(nullptr) / (24 * 60 * 60));
+}
+
+PackHeader makePackHeader() {
+    PackHeader header;
+    memcpy(header.magic, packMagic, sizeof(packMagic));
+    header.byteOrder = byteOrderMark;
+    header.reserved = 0;
+    return header;
+}
+
+// holds an flock() on a file descriptor
+class FileLock {
+public:
+    explicit FileLock(int fd, int operation): fd_{fd} {
+        while(flock(fd_, operation) == -1 && errno == EINTR) {
+        }
+    }
+
+    ~FileLock() {
+        flock(fd_, LOCK_UN);
+    }
+
+    // the descriptor changes when a pack is compacted
+    void setFd(int fd) {
+        fd_ = fd;
+    }
+
+private:
+    int fd_;
+};
+
+bool writeAll(int fd, const char* data, size_t size, off_t offset) {
+    while(size > 0) {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if(n == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+ThumbnailPack::ThumbnailPack():
+    fd_{-1},
+    data_{nullptr},
+    mappedSize_{0},
+    indexedSize_{0},
+    deadSize_{0} {
+}
+
+ThumbnailPack::~ThumbnailPack() {
+    if(data_) {
+        munmap(const_cast<char*>(data_), mappedSize_);
+    }
+    if(fd_ != -1) {
+        close(fd_);
+    }
+}
+
+// static
+std::shared_ptr<ThumbnailPack> ThumbnailPack::forDirectory(const FilePath& dirPath, bool large) {
+    auto uri = dirPath.uri();
+    if(!uri) {
+        return nullptr;
+    }
+    CStrPtr md5{g_compute_checksum_for_string(G_CHECKSUM_MD5, uri.get(), -1)};
+    std::string dir = g_get_user_cache_dir();
+    dir += large ? "/panda-files/thumbnail-packs/large" : "/panda-files/thumbnail-packs/normal";
+    std::string path = dir + '/' + md5.get() + ".pack";
+
+    // the packs used recently are kept open, the most recently used first
+    static std::mutex openPacksMutex;
+    static std::list<std::pair<std::string, std::shared_ptr<ThumbnailPack>>> openPacks;
+    std::lock_guard<std::mutex> lock{openPacksMutex};
+    for(auto it = openPacks.begin(); it != openPacks.end(); ++it) {
+        if(it->first == path) {
+            openPacks.splice(openPacks.begin(), openPacks, it);
+            return it->second;
+        }
+    }
+
+    if(g_mkdir_with_parents(dir.c_str(), 0700) != 0) {
+        return nullptr;
+    }
+    // once per run, before any pack of the directory is open in this process
+    static bool expiredPacksRemoved[2] = {false, false};
+    if(!expiredPacksRemoved[large]) {
+        expiredPacksRemoved[large] = true;
+        removeExpiredPacks(dir, path);
+    }
+    std::shared_ptr<ThumbnailPack> pack{new ThumbnailPack()};
+    if(!pack->open(path)) {
+        return nullptr;
+    }
+    openPacks.emplace_front(path, pack);
+    if(openPacks.size() > maxOpenPacks) {
+        openPacks.pop_back();
+    }
+    return pack;
+}
+
+// the packs of the other processes are reopened when they find them removed
+void ThumbnailPack::removeExpiredPacks(const std::string& dir, const std::string& keptPath) {
+    GDir* gdir = g_dir_open(dir.c_str(), 0, nullptr);
+    if(!gdir) {
+        return;
+    }
+    const time_t minMtime = time(nullptr) - time_t(maxUnusedDays) * 24 * 60 * 60;
+    while(const char* name = g_dir_read_name(gdir)) {
+        // also the temporary files left by a compaction which did not complete
+        std::string path = dir + '/' + name;
+        struct stat statbuf;
+        if(path != keptPath && stat(path.c_str(), &statbuf) == 0 && S_ISREG(statbuf.st_mode)
+                && statbuf.st_mtime < minMtime) {
+            unlink(path.c_str());
+        }
+    }
+    g_dir_close(gdir);
+}
+
+bool ThumbnailPack::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    path_ = path;
+    return openFile();
+}
+
+bool ThumbnailPack::openFile() {
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd_ == -1) {
+        return false;
+    }
+
+    FileLock fileLock{fd_, LOCK_EX};
+    struct stat statbuf;
+    if(fstat(fd_, &statbuf) == -1) {
+        return false;
+    }
+    size_t size = statbuf.st_size;
+    const PackHeader header = makePackHeader();
+    // a pack which cannot be mapped is left alone, other processes may be using it
+    if(size >= sizeof(header) && !map(size)) {
+        return false;
+    }
+    if(size < sizeof(header) || memcmp(data_, &header, sizeof(header)) != 0) {
+        // a new pack, or one of another format: start it over
+        if(ftruncate(fd_, 0) == -1 || !writeAll(fd_, reinterpret_cast<const char*>(&header), sizeof(header), 0)) {
+            return false;
+        }
+        size = sizeof(header);
+        if(!map(size)) {
+            return false;
+        }
+    }
+
+    // the last use of the pack, see removeExpiredPacks()
+    futimens(fd_, nullptr);
+
+    indexedSize_ = sizeof(PackHeader);
+    indexRecords();
+    // the file may have been replaced by a compaction before it was locked; then it is
+    // reopened when it is used, and must not replace the new pack
+    if(deadSize_ > minCompactSize && deadSize_ > mappedSize_ / 2 && !isReplaced()) {
+        if(compact()) {
+            fileLock.setFd(fd_);
+        }
+    }
+    return true;
+}
+
+// true if the pack file was replaced, by a compaction in another process, since it was opened
+bool ThumbnailPack::isReplaced() const {
+    struct stat fdStat, pathStat;
+    return fstat(fd_, &fdStat) != 0 || stat(path_.c_str(), &pathStat) != 0
+           || fdStat.st_ino != pathStat.st_ino || fdStat.st_dev != pathStat.st_dev;
+}
+
+// otherwise the records would be read from and appended to a file nobody else sees anymore
+bool ThumbnailPack::reopenIfReplaced() {
+    if(fd_ != -1 && !isReplaced()) {
+        return true;
+    }
+    if(data_) {
+        munmap(const_cast<char*>(data_), mappedSize_);
+        data_ = nullptr;
+        mappedSize_ = 0;
+    }
+    if(fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+    index_.clear();
+    indexedSize_ = 0;
+    deadSize_ = 0;
+    return openFile();
+}
+
+bool ThumbnailPack::map(size_t size) {
+    if(data_) {
+        munmap(const_cast<char*>(data_), mappedSize_);
+        data_ = nullptr;
+        mappedSize_ = 0;
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const char*>(data);
+    mappedSize_ = size;
+    return true;
+}
+
+// maps the file up to end at least, if it is that large
+bool ThumbnailPack::ensureMapped(size_t end) {
+    if(end <= mappedSize_) {
+        return true;
+    }
+    struct stat statbuf;
+    return fstat(fd_, &statbuf) == 0 && size_t(statbuf.st_size) >= end && map(statbuf.st_size);
+}
+
+// indexes the records mapped after the ones already indexed
+void ThumbnailPack::indexRecords() {
+    const quint32 minLastSeen = today() - maxUnusedDays;
+    size_t offset = indexedSize_;
+    while(offset + sizeof(RecordHeader) <= mappedSize_) {
+        RecordHeader header;
+        memcpy(&header, data_ + offset, sizeof(header));
+        size_t size = sizeof(header) + header.dataSize;
+        if(header.magic != recordMagic || offset + size > mappedSize_) {
+            break; // not written completely, the next add() truncates it
+        }
+        if(header.lastSeen >= minLastSeen) {
+            addToIndex(std::string{header.key, keyLength}, offset, size);
+        }
+        else { // expired, dropped by the next compaction
+            deadSize_ += size;
+        }
+        offset += size;
+    }
+    indexedSize_ = offset;
+}
+
+void ThumbnailPack::addToIndex(std::string key, size_t offset, size_t size) {
+    auto result = index_.emplace(std::move(key), Record{offset, size});
+    if(!result.second) { // replaces an older record
+        deadSize_ += result.first->second.size;
+        result.first->second = Record{offset, size};
+    }
+}
+
+QImage ThumbnailPack::find(const char* key, quint64 mtime) {
+    std::string keyStr{key, keyLength};
+    QByteArray data;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(!reopenIfReplaced()) {
+            return QImage();
+        }
+        // the mapping is only read with the pack locked, since a writer may truncate it
+        FileLock fileLock{fd_, LOCK_SH};
+        auto it = index_.find(keyStr);
+        if(it == index_.end()) {
+            // another process may have added it since the pack was indexed
+            struct stat statbuf;
+            if(fstat(fd_, &statbuf) == 0 && size_t(statbuf.st_size) > indexedSize_) {
+                if(size_t(statbuf.st_size) <= mappedSize_ || map(statbuf.st_size)) {
+                    indexRecords();
+                }
+                it = index_.find(keyStr);
+            }
+            if(it == index_.end()) {
+                return QImage();
+            }
+        }
+
+        const Record record = it->second;
+        // the records added by this process after the mapping are not mapped yet
+        if(!ensureMapped(record.offset + record.size)) {
+            return QImage();
+        }
+        RecordHeader header;
+        memcpy(&header, data_ + record.offset, sizeof(header));
+        if(header.mtime != mtime) { // outdated
+            return QImage();
+        }
+        // keep it from expiring, with at most a write per record and day; the other processes
+        // only write the same value while the pack is shared-locked
+        const quint32 day = today();
+        if(header.lastSeen != day) {
+            pwrite(fd_, &day, sizeof(day), record.offset + offsetof(RecordHeader, lastSeen));
+        }
+        // decoded after the pack is unlocked
+        data = QByteArray{data_ + record.offset + sizeof(header), int(header.dataSize)};
+    }
+    QImage image;
+    image.loadFromData(data, "PNG");
+    return image;
+}
+
+bool ThumbnailPack::add(const char* key, quint64 mtime, const QImage& image) {
+    // compress the image before locking the pack
+    QByteArray record;
+    record.resize(sizeof(RecordHeader));
+    QBuffer buffer{&record};
+    buffer.open(QIODevice::WriteOnly | QIODevice::Append);
+    if(!image.save(&buffer, "PNG")) {
+        return false;
+    }
+    RecordHeader header;
+    header.magic = recordMagic;
+    header.dataSize = record.size() - sizeof(header);
+    header.mtime = mtime;
+    memcpy(header.key, key, keyLength);
+    header.lastSeen = today();
+    header.reserved = 0;
+    memcpy(record.data(), &header, sizeof(header));
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    // another process may compact the pack while this one waits for the lock
+    std::unique_ptr<FileLock> fileLock;
+    for(;;) {
+        if(!reopenIfReplaced()) {
+            return false;
+        }
+        fileLock.reset(new FileLock{fd_, LOCK_EX});
+        if(!isReplaced()) {
+            break;
+        }
+        fileLock.reset();
+    }
+    struct stat statbuf;
+    if(fstat(fd_, &statbuf) == -1) {
+        return false;
+    }
+    if(size_t(statbuf.st_size) > indexedSize_) {
+        // index the records added by other processes; indexedSize_ is only the end of the
+        // complete records once they are all indexed
+        if(!map(statbuf.st_size)) {
+            return false;
+        }
+        indexRecords();
+        // the end of the file might have been left incomplete by a crash
+        if(size_t(statbuf.st_size) > indexedSize_ && ftruncate(fd_, indexedSize_) == -1) {
+            return false;
+        }
+    }
+    if(!writeAll(fd_, record.constData(), record.size(), indexedSize_)) {
+        ftruncate(fd_, indexedSize_);
+        return false;
+    }
+    addToIndex(std::string{key, keyLength}, indexedSize_, record.size());
+    indexedSize_ += record.size();
+    return true;
+}
+
+// rewrites the pack without the replaced and expired records, with the pack locked
+bool ThumbnailPack::compact() {
+    std::vector<Record> records;
+    records.reserve(index_.size());
+    for(auto& item: index_) {
+        records.push_back(item.second);
+    }
+    std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.offset < b.offset;
+    });
+
+    std::string tmpPath = path_ + ".XXXXXX";
+    int fd = g_mkstemp_full(&tmpPath[0], O_RDWR | O_CLOEXEC, 0600);
+    if(fd == -1) {
+        return false;
+    }
+    // lock it before it replaces the pack
+    flock(fd, LOCK_EX);
+    const PackHeader header = makePackHeader();
+    bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+    off_t offset = sizeof(header);
+    for(auto it = records.cbegin(); ok && it != records.cend(); ++it) {
+        ok = writeAll(fd, data_ + it->offset, it->size, offset);
+        offset += it->size;
+    }
+    // the other processes using the pack see that the file is replaced and reopen it
+    if(!ok || rename(tmpPath.c_str(), path_.c_str()) == -1) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // closing the old file releases its lock
+    close(fd_);
+    fd_ = fd;
+    index_.clear();
+    deadSize_ = 0;
+    indexedSize_ = sizeof(header);
+    if(map(offset)) {
+        indexRecords();
+    }
+    return true;
+}
+
+} // namespace Fm
@@ -0,0 +1,86 @@
+#ifndef FM2_THUMBNAILPACK_H
+#define FM2_THUMBNAILPACK_H
+
+#include "../libfmqtglobals.h"
+#include <QImage>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "filepath.h"
+
+namespace Fm {
+
+/*
+ * A memory-mapped file holding the thumbnails of the files of one directory at one size.
+ *
+ * Loading the thumbnails of a viewport from the freedesktop cache costs an open, a read and
+ * a PNG decode per file. With a pack, the thumbnails of a directory are found in a single
+ * mapping, indexed once when the pack is opened. Packs are kept in
+ * $XDG_CACHE_HOME/panda-files/thumbnail-packs/normal|large/{md5 of the directory URI}.pack
+ * and complement the freedesktop PNGs, which are still written for other applications.
+ *
+ * The file is a header followed by records, each one being a small header (the md5 of the
+ * file URI, its mtime, the day it was last found or added, and the data size) and the thumbnail
+ * compressed in PNG. Records are only appended, with an exclusive flock() so that several
+ * processes can share a pack, and a newer record replaces an older one with the same key.
+ * A record not found for a few months is dropped, since its file was most likely deleted or
+ * renamed. A pack is compacted when it is opened if most of it is made of replaced or dropped
+ * records; the compacted file replaces the pack, and the other processes reopen it when they
+ * find that the file they have open is not the pack anymore. The packs not opened for a few
+ * months, such as the ones of deleted directories, are removed when the first pack of a size
+ * is opened.
+ */
+class LIBFM_QT_API ThumbnailPack {
+public:
+    ~ThumbnailPack();
+
+    ThumbnailPack(const ThumbnailPack& other) = delete;
+
+    ThumbnailPack& operator = (const ThumbnailPack& other) = delete;
+
+    // returns the pack of the directory, opening or creating it as needed, or nullptr on failure
+    static std::shared_ptr<ThumbnailPack> forDirectory(const FilePath& dirPath, bool large);
+
+    // key is the md5 of the URI of the file in hex, as in the name of freedesktop thumbnails.
+    // returns a null image if no thumbnail is found for this mtime.
+    QImage find(const char* key, quint64 mtime);
+
+    bool add(const char* key, quint64 mtime, const QImage& image);
+
+private:
+    explicit ThumbnailPack();
+
+    static void removeExpiredPacks(const std::string& dir, const std::string& keptPath);
+
+    struct Record {
+        size_t offset;
+        size_t size; // including its header
+    };
+
+    bool open(const std::string& path);
+
+    // with mutex_ locked
+    bool openFile();
+    bool isReplaced() const;
+    bool reopenIfReplaced();
+    bool map(size_t size);
+    bool ensureMapped(size_t end);
+    void indexRecords();
+    void addToIndex(std::string key, size_t offset, size_t size);
+    bool compact();
+
+private:
+    std::string path_;
+    int fd_;
+    const char* data_;      // mapping of the file
+    size_t mappedSize_;
+    size_t indexedSize_;    // end of the last record indexed
+    size_t deadSize_;       // bytes of replaced or expired records
+    std::unordered_map<std::string, Record> index_;
+    std::mutex mutex_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILPACK_H
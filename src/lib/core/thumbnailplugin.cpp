@@ -0,0 +1,52 @@
+#include "thumbnailplugin.h"
+#include "mimetype.h"
+#ifdef HAVE_POPPLER
+#include "pdfthumbnailplugin.h"
+#endif
+#ifdef HAVE_FFMPEG
+#include "videothumbnailplugin.h"
+#endif
+
+namespace Fm {
+
+std::mutex ThumbnailPlugin::mutex_;
+std::vector<std::shared_ptr<const ThumbnailPlugin>> ThumbnailPlugin::plugins_;
+
+ThumbnailPlugin::~ThumbnailPlugin() {
+}
+
+// static
+void ThumbnailPlugin::registerPlugin(std::shared_ptr<const ThumbnailPlugin> plugin) {
+    registerBuiltinPlugins();
+    std::lock_guard<std::mutex> lock{mutex_};
+    // the plugins registered later take precedence over the built-in ones
+    plugins_.insert(plugins_.begin(), std::move(plugin));
+}
+
+// static
+std::shared_ptr<const ThumbnailPlugin> ThumbnailPlugin::forMimeType(const std::shared_ptr<const MimeType>& mimeType) {
+    registerBuiltinPlugins();
+    std::lock_guard<std::mutex> lock{mutex_};
+    for(auto& plugin: plugins_) {
+        if(plugin->supports(mimeType->name())) {
+            return plugin;
+        }
+    }
+    return nullptr;
+}
+
+// static
+void ThumbnailPlugin::registerBuiltinPlugins() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        std::lock_guard<std::mutex> lock{mutex_};
+#ifdef HAVE_POPPLER
+        plugins_.emplace_back(std::make_shared<PdfThumbnailPlugin>());
+#endif
+#ifdef HAVE_FFMPEG
+        plugins_.emplace_back(std::make_shared<VideoThumbnailPlugin>());
+#endif
+    });
+}
+
+} // namespace Fm
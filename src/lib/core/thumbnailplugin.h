@@ -0,0 +1,47 @@
+#ifndef FM2_THUMBNAILPLUGIN_H
+#define FM2_THUMBNAILPLUGIN_H
+
+#include "../libfmqtglobals.h"
+#include <QImage>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <gio/gio.h>
+#include "filepath.h"
+
+namespace Fm {
+
+class MimeType;
+
+/*
+ * Makes thumbnails in the thumbnail job's thread, without running an external thumbnailer.
+ *
+ * The plugins are tried before the external thumbnailers of Fm::Thumbnailer, which are still
+ * used when no plugin supports a file or a plugin fails with it. Built-in plugins are
+ * registered when they are enabled at build time: PDF documents with poppler-qt5 and videos
+ * with FFmpeg. They may be called from several threads at once.
+ */
+class LIBFM_QT_API ThumbnailPlugin {
+public:
+    virtual ~ThumbnailPlugin();
+
+    virtual bool supports(const char* mimeType) const = 0;
+
+    // returns an image fitting in size x size, or a null image on failure or when cancelled
+    virtual QImage generate(const FilePath& path, int size, GCancellable* cancellable) const = 0;
+
+    static void registerPlugin(std::shared_ptr<const ThumbnailPlugin> plugin);
+
+    // the plugin supporting the mime type, or nullptr
+    static std::shared_ptr<const ThumbnailPlugin> forMimeType(const std::shared_ptr<const MimeType>& mimeType);
+
+private:
+    static void registerBuiltinPlugins();
+
+    static std::mutex mutex_;
+    static std::vector<std::shared_ptr<const ThumbnailPlugin>> plugins_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILPLUGIN_H
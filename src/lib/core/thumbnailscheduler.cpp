@@ -0,0 +1,250 @@
+#include "thumbnailscheduler.h"
+#include <QTimer>
+#include <QPointer>
+#include "thumbnailer.h"
+#include "jobexecutor.h"
+
+namespace Fm {
+
+// the files loaded by a job; small enough for a job not to delay the requests made after it
+static const size_t maxBatchSize = 8;
+// the queued requests looked at for a batch
+static const int maxBatchScan = 64;
+
+ThumbnailScheduler::ThumbnailScheduler(QObject* parent):
+    QObject(parent),
+    serial_{0},
+    dispatchQueued_{false} {
+}
+
+ThumbnailScheduler::~ThumbnailScheduler() {
+    cancelAll();
+}
+
+void ThumbnailScheduler::request(const std::shared_ptr<const FileInfo>& file, int size, Priority priority) {
+    Key key{file.get(), size};
+    auto it = requests_.find(key);
+    if(it == requests_.end()) {
+        it = requests_.emplace(key, Request{file, queue_.end(), nullptr, nullptr, 0, GCancellablePtr{}, false, false}).first;
+    }
+    else if(it->second.job || it->second.thumbnailerCancellable) {
+        return; // already in flight
+    }
+    enqueue(key, it->second, priority);
+
+    // requests usually come in bursts while a view is painted
+    if(!dispatchQueued_) {
+        dispatchQueued_ = true;
+        QTimer::singleShot(0, this, &ThumbnailScheduler::dispatch);
+    }
+}
+
+bool ThumbnailScheduler::isPending(const FileInfo* file, int size) const {
+    return requests_.find(Key{file, size}) != requests_.cend();
+}
+
+void ThumbnailScheduler::setPriority(const FileInfo* file, int size, Priority priority) {
+    Key key{file, size};
+    auto it = requests_.find(key);
+    if(it != requests_.end() && it->second.queued != queue_.end()) {
+        enqueue(key, it->second, priority);
+    }
+}
+
+void ThumbnailScheduler::enqueue(const Key& key, Request& request, Priority priority) {
+    if(request.queued != queue_.end()) {
+        queue_.erase(request.queued);
+    }
+    // a new serial number puts it after the requests made before at the same priority
+    request.queued = queue_.emplace(std::make_pair(static_cast<int>(priority), serial_++), key).first;
+}
+
+void ThumbnailScheduler::cancel(const FileInfo* file, int size) {
+    auto it = requests_.find(Key{file, size});
+    if(it != requests_.end()) {
+        cancel(it);
+    }
+}
+
+void ThumbnailScheduler::cancel(RequestMap::iterator it) {
+    auto& request = it->second;
+    ThumbnailJob* job = request.job;
+    if(request.queued != queue_.end()) {
+        queue_.erase(request.queued);
+    }
+    if(request.thumbnailerCancellable) {
+        // onThumbnailerFinished() ignores it then
+        g_cancellable_cancel(request.thumbnailerCancellable.get());
+    }
+    requests_.erase(it);
+    // the other files of the job may still be wanted; onJobFinished() forgets the job
+    if(job && !hasRequests(job)) {
+        job->cancel();
+    }
+}
+
+bool ThumbnailScheduler::hasRequests(ThumbnailJob* job) const {
+    auto jobIt = jobs_.find(job);
+    if(jobIt == jobs_.cend()) {
+        return false;
+    }
+    for(const auto& key: jobIt->second) {
+        auto it = requests_.find(key);
+        if(it != requests_.cend() && it->second.job == job) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThumbnailScheduler::cancelSize(int size) {
+    for(auto it = requests_.begin(); it != requests_.end();) {
+        auto next = std::next(it);
+        if(it->first.size == size) {
+            cancel(it);
+        }
+        it = next;
+    }
+}
+
+void ThumbnailScheduler::cancelAll() {
+    for(auto& job: jobs_) {
+        job.first->cancel();
+    }
+    for(auto& request: requests_) {
+        if(request.second.thumbnailerCancellable) {
+            g_cancellable_cancel(request.second.thumbnailerCancellable.get());
+        }
+    }
+    requests_.clear();
+    queue_.clear();
+}
+
+void ThumbnailScheduler::dispatch() {
+    dispatchQueued_ = false;
+    // keep the rest queued here, where it can still be reordered or cancelled
+    int maxJobs = JobExecutor::globalInstance()->maxThreadCount(Job::ExecutionClass::THUMBNAIL);
+    while(static_cast<int>(jobs_.size()) < maxJobs && !queue_.empty()) {
+        // the first request and the next ones of the same priority for files of the same directory
+        const auto first = queue_.begin();
+        const int priority = first->first.first;
+        const Key firstKey = first->second;
+        const FilePath& dirPath = firstKey.file->dirPath();
+        // the result of external thumbnailers is loaded alone, without running them again
+        const auto& firstRequest = requests_.find(firstKey)->second;
+        const bool thumbnailersRun = firstRequest.thumbnailersRun;
+        const bool thumbnailersSucceeded = firstRequest.thumbnailersSucceeded;
+        const size_t batchSize = thumbnailersRun ? 1 : maxBatchSize;
+        std::vector<Key> keys;
+        FileInfoList files;
+        int scanned = 0;
+        for(auto it = first; it != queue_.end() && it->first.first == priority
+                && keys.size() < batchSize && scanned < maxBatchScan; ++scanned) {
+            const Key key = it->second;
+            if(key.size != firstKey.size || key.file->dirPath() != dirPath
+                    || (it != first && requests_.find(key)->second.thumbnailersRun)) {
+                ++it;
+                continue;
+            }
+            it = queue_.erase(it);
+            auto& request = requests_.find(key)->second;
+            request.queued = queue_.end();
+            keys.push_back(key);
+            files.push_back(request.file);
+        }
+
+        auto job = new ThumbnailJob(std::move(files), firstKey.size);
+        if(thumbnailersRun) {
+            job->setThumbnailersRun(thumbnailersSucceeded);
+        }
+        for(const auto& key: keys) {
+            requests_.find(key)->second.job = job;
+        }
+        jobs_.emplace(job, std::move(keys));
+        job->setAutoDelete(true);
+        connect(job, &ThumbnailJob::thumbnailLoaded, this, &ThumbnailScheduler::onThumbnailLoaded, Qt::BlockingQueuedConnection);
+        connect(job, &ThumbnailJob::finished, this, &ThumbnailScheduler::onJobFinished, Qt::BlockingQueuedConnection);
+        job->runAsync();
+    }
+}
+
+void ThumbnailScheduler::onThumbnailLoaded(const std::shared_ptr<const FileInfo>& file, int size, const QImage& image, const QImage& transparentImage) {
+    auto it = requests_.find(Key{file.get(), size});
+    // ignore a request cancelled meanwhile, even if it has been made again since then
+    if(it != requests_.end() && it->second.job == sender()) {
+        requests_.erase(it);
+        Q_EMIT thumbnailLoaded(file, size, image, transparentImage);
+    }
+}
+
+void ThumbnailScheduler::onJobFinished() {
+    auto job = static_cast<ThumbnailJob*>(sender());
+    auto jobIt = jobs_.find(job);
+    if(jobIt == jobs_.end()) {
+        return;
+    }
+    // the files left to external thumbnailers, unless they have been cancelled meanwhile
+    for(const auto& external: job->externalRequests()) {
+        Key key{external.file.get(), job->size()};
+        auto it = requests_.find(key);
+        if(it != requests_.end() && it->second.job == job) {
+            auto& request = it->second;
+            request.job = nullptr;
+            request.external = std::make_shared<ThumbnailJob::ExternalRequest>(external);
+            request.thumbnailerIndex = 0;
+            runThumbnailer(key, request);
+        }
+    }
+    for(const auto& key: jobIt->second) {
+        auto it = requests_.find(key);
+        if(it != requests_.end() && it->second.job == job) {
+            // the job ended without reporting the thumbnail
+            requests_.erase(it);
+        }
+    }
+    jobs_.erase(jobIt);
+    dispatch();
+}
+
+void ThumbnailScheduler::runThumbnailer(const Key& key, Request& request) {
+    const auto& external = *request.external;
+    // a new cancellable for each one, so that a late result of the previous one is ignored
+    request.thumbnailerCancellable = GCancellablePtr{g_cancellable_new(), false};
+    GCancellable* cancellable = request.thumbnailerCancellable.get();
+    QPointer<ThumbnailScheduler> self{this};
+    // the process is waited for by the main loop, which calls this back in this thread
+    external.thumbnailers[request.thumbnailerIndex]->start(external.uri.c_str(), external.thumbnailFilename.c_str(),
+                                                           external.size, cancellable,
+                                                           [self, key, cancellable](Thumbnailer::Result result) {
+        if(self) {
+            self->onThumbnailerFinished(key, cancellable, result == Thumbnailer::Result::SUCCEEDED);
+        }
+    });
+}
+
+void ThumbnailScheduler::onThumbnailerFinished(const Key& key, GCancellable* cancellable, bool succeeded) {
+    auto it = requests_.find(key);
+    // ignore a request cancelled meanwhile, even if it has been made again since then
+    if(it == requests_.end() || it->second.thumbnailerCancellable.get() != cancellable) {
+        return;
+    }
+    auto& request = it->second;
+    // try all available external thumbnailers for it until success
+    if(!succeeded && request.thumbnailerIndex + 1 < request.external->thumbnailers.size()) {
+        ++request.thumbnailerIndex;
+        runThumbnailer(key, request);
+        return;
+    }
+    request.external.reset();
+    request.thumbnailerCancellable.reset();
+    request.thumbnailersRun = true;
+    request.thumbnailersSucceeded = succeeded;
+    // it was being shown when its job was dispatched
+    enqueue(key, request, Priority::VISIBLE);
+    if(!dispatchQueued_) {
+        dispatchQueued_ = true;
+        QTimer::singleShot(0, this, &ThumbnailScheduler::dispatch);
+    }
+}
+
+} // namespace Fm
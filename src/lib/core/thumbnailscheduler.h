@@ -0,0 +1,130 @@
+#ifndef FM2_THUMBNAILSCHEDULER_H
+#define FM2_THUMBNAILSCHEDULER_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QImage>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include "fileinfo.h"
+#include "gioptrs.h"
+#include "thumbnailjob.h"
+
+namespace Fm {
+
+/*
+ * Loads the thumbnails requested by a FolderModel. A ThumbnailJob loads a small batch of files
+ * of the same directory, at the same size and priority, so that it can share the lookups.
+ *
+ * Requests wait in a priority queue: the files of the visible rows are loaded first,
+ * then the prefetched rows around them, then the rest, each in the order of request.
+ * No more jobs than the threads of the thumbnail pool are in flight, so that the queue
+ * can still be reordered when the view is scrolled. A request can be cancelled on its own,
+ * whether it is queued or in flight, and no thumbnailLoaded() is emitted for it then; a job
+ * is cancelled when none of its requests is left.
+ *
+ * The external thumbnailers are not run by the jobs, which would keep a thumbnail thread waiting
+ * for the process: a job leaves such files to the scheduler, which starts the thumbnailers
+ * from the main loop once the job has finished, and then loads what they made in a new job.
+ */
+class LIBFM_QT_API ThumbnailScheduler: public QObject {
+    Q_OBJECT
+public:
+    enum class Priority {
+        VISIBLE,
+        PREFETCH,
+        NORMAL
+    };
+
+    explicit ThumbnailScheduler(QObject* parent = nullptr);
+
+    ~ThumbnailScheduler() override;
+
+    // a request already queued for the file is moved to the given priority
+    void request(const std::shared_ptr<const FileInfo>& file, int size, Priority priority = Priority::NORMAL);
+
+    // queued or in flight
+    bool isPending(const FileInfo* file, int size) const;
+
+    // only affects a queued request, not one in flight or whose thumbnailers are running
+    void setPriority(const FileInfo* file, int size, Priority priority);
+
+    void cancel(const FileInfo* file, int size);
+
+    void cancelSize(int size);
+
+    void cancelAll();
+
+    size_t pendingCount() const {
+        return requests_.size();
+    }
+
+Q_SIGNALS:
+    void thumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image, const QImage& transparentImage);
+
+private Q_SLOTS:
+    void dispatch();
+
+    void onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image, const QImage& transparentImage);
+
+    void onJobFinished();
+
+private:
+    struct Key {
+        const FileInfo* file;
+        int size;
+
+        bool operator==(const Key& other) const {
+            return file == other.file && size == other.size;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const {
+            return std::hash<const FileInfo*>()(key.file) ^ std::hash<int>()(key.size);
+        }
+    };
+
+    // the queue is ordered by priority first, then by the order of the requests
+    typedef std::map<std::pair<int, std::uint64_t>, Key> Queue;
+
+    struct Request {
+        std::shared_ptr<const FileInfo> file;
+        Queue::iterator queued; // queue_.end() if the request is in flight
+        ThumbnailJob* job;      // the job loading it, if it is in flight
+        // set while its external thumbnailers are run, one after another
+        std::shared_ptr<ThumbnailJob::ExternalRequest> external;
+        size_t thumbnailerIndex;
+        GCancellablePtr thumbnailerCancellable;
+        // set once they have been run, for the job loading the result
+        bool thumbnailersRun;
+        bool thumbnailersSucceeded;
+    };
+
+    typedef std::unordered_map<Key, Request, KeyHash> RequestMap;
+
+    void enqueue(const Key& key, Request& request, Priority priority);
+
+    void cancel(RequestMap::iterator it);
+
+    // starts the current thumbnailer of the request
+    void runThumbnailer(const Key& key, Request& request);
+
+    void onThumbnailerFinished(const Key& key, GCancellable* cancellable, bool succeeded);
+
+    bool hasRequests(ThumbnailJob* job) const;
+
+private:
+    RequestMap requests_;
+    Queue queue_;
+    std::unordered_map<ThumbnailJob*, std::vector<Key>> jobs_;
+    std::uint64_t serial_;
+    bool dispatchQueued_;
+};
+
+} // namespace Fm
+
+#endif // FM2_THUMBNAILSCHEDULER_H
@@ -0,0 +1,165 @@
+#ifdef HAVE_FFMPEG
+
+#include "videothumbnailplugin.h"
+#include <QSize>
+#include <memory>
+#include <glib.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace Fm {
+
+namespace {
+
+// the thumbnail is taken at this fraction of the duration, after the opening credits
+const int seekDivisor = 10;
+// give up when no frame is decoded after reading this many packets
+const int maxPackets = 1000;
+
+struct FormatContextDeleter {
+    void operator()(AVFormatContext* context) const {
+        avformat_close_input(&context);
+    }
+};
+
+struct CodecContextDeleter {
+    void operator()(AVCodecContext* context) const {
+        avcodec_free_context(&context);
+    }
+};
+
+struct PacketDeleter {
+    void operator()(AVPacket* packet) const {
+        av_packet_free(&packet);
+    }
+};
+
+struct FrameDeleter {
+    void operator()(AVFrame* frame) const {
+        av_frame_free(&frame);
+    }
+};
+
+// makes FFmpeg abort blocking reads when the job is cancelled
+int interruptCallback(void* opaque) {
+    return g_cancellable_is_cancelled(static_cast<GCancellable*>(opaque)) ? 1 : 0;
+}
+
+QImage frameToImage(const AVFrame* frame, int size) {
+    // take the pixel aspect ratio into account
+    QSize displaySize{frame->width, frame->height};
+    if(frame->sample_aspect_ratio.num > 0 && frame->sample_aspect_ratio.den > 0) {
+        displaySize.setWidth(int(qint64(frame->width) * frame->sample_aspect_ratio.num / frame->sample_aspect_ratio.den));
+    }
+    QSize imageSize = displaySize.scaled(size, size, Qt::KeepAspectRatio).expandedTo(QSize{1, 1});
+
+    SwsContext* sws = sws_getContext(frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                     imageSize.width(), imageSize.height(), AV_PIX_FMT_RGB32,
+                                     SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if(!sws) {
+        return QImage();
+    }
+    // AV_PIX_FMT_RGB32 has the native byte order of QImage::Format_RGB32
+    QImage image{imageSize, QImage::Format_RGB32};
+    uint8_t* data[4] = {image.bits(), nullptr, nullptr, nullptr};
+    int linesize[4] = {image.bytesPerLine(), 0, 0, 0};
+    sws_scale(sws, frame->data, frame->linesize, 0, frame->height, data, linesize);
+    sws_freeContext(sws);
+    return image;
+}
+
+} // namespace
+
+bool VideoThumbnailPlugin::supports(const char* mimeType) const {
+    return g_str_has_prefix(mimeType, "video/");
+}
+
+QImage VideoThumbnailPlugin::generate(const FilePath& path, int size, GCancellable* cancellable) const {
+    auto localPath = path.localPath();
+    if(!localPath) {
+        return QImage();
+    }
+
+    AVFormatContext* formatContext = avformat_alloc_context();
+    if(!formatContext) {
+        return QImage();
+    }
+    formatContext->interrupt_callback.callback = interruptCallback;
+    formatContext->interrupt_callback.opaque = cancellable;
+    // the context is freed on failure
+    if(avformat_open_input(&formatContext, localPath.get(), nullptr, nullptr) < 0) {
+        return QImage();
+    }
+    std::unique_ptr<AVFormatContext, FormatContextDeleter> format{formatContext};
+    if(avformat_find_stream_info(format.get(), nullptr) < 0) {
+        return QImage();
+    }
+    int streamIndex = av_find_best_stream(format.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if(streamIndex < 0) {
+        return QImage();
+    }
+    AVStream* stream = format->streams[streamIndex];
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if(!codec) {
+        return QImage();
+    }
+    std::unique_ptr<AVCodecContext, CodecContextDeleter> codecContext{avcodec_alloc_context3(codec)};
+    if(!codecContext || avcodec_parameters_to_context(codecContext.get(), stream->codecpar) < 0) {
+        return QImage();
+    }
+    // a thumbnail is small, the other threads decode other thumbnails
+    codecContext->thread_count = 1;
+    if(avcodec_open2(codecContext.get(), codec, nullptr) < 0) {
+        return QImage();
+    }
+
+    // seek to the key frame before the thumbnail position, in AV_TIME_BASE units
+    if(format->duration > 0) {
+        if(av_seek_frame(format.get(), -1, format->duration / seekDivisor, AVSEEK_FLAG_BACKWARD) >= 0) {
+            avcodec_flush_buffers(codecContext.get());
+        }
+    }
+
+    std::unique_ptr<AVPacket, PacketDeleter> packet{av_packet_alloc()};
+    std::unique_ptr<AVFrame, FrameDeleter> frame{av_frame_alloc()};
+    if(!packet || !frame) {
+        return QImage();
+    }
+    bool decoded = false;
+    bool endOfFile = false;
+    for(int i = 0; i < maxPackets && !decoded && !g_cancellable_is_cancelled(cancellable); ++i) {
+        if(!endOfFile) {
+            int ret = av_read_frame(format.get(), packet.get());
+            if(ret < 0) {
+                // drain the decoder
+                endOfFile = true;
+                avcodec_send_packet(codecContext.get(), nullptr);
+            }
+            else {
+                if(packet->stream_index == streamIndex) {
+                    avcodec_send_packet(codecContext.get(), packet.get());
+                }
+                av_packet_unref(packet.get());
+            }
+        }
+        int ret = avcodec_receive_frame(codecContext.get(), frame.get());
+        if(ret == 0) {
+            decoded = true;
+        }
+        else if(ret != AVERROR(EAGAIN)) { // an error or the end of the stream
+            break;
+        }
+    }
+    if(!decoded || g_cancellable_is_cancelled(cancellable)) {
+        return QImage();
+    }
+    return frameToImage(frame.get(), size);
+}
+
+} // namespace Fm
+
+#endif // HAVE_FFMPEG
@@ -0,0 +1,18 @@
+#ifndef FM2_VIDEOTHUMBNAILPLUGIN_H
+#define FM2_VIDEOTHUMBNAILPLUGIN_H
+
+#include "thumbnailplugin.h"
+
+namespace Fm {
+
+// decodes a key frame of local video files with FFmpeg, only built with HAVE_FFMPEG
+class VideoThumbnailPlugin: public ThumbnailPlugin {
+public:
+    bool supports(const char* mimeType) const override;
+
+    QImage generate(const FilePath& path, int size, GCancellable* cancellable) const override;
+};
+
+} // namespace Fm
+
+#endif // FM2_VIDEOTHUMBNAILPLUGIN_H
@@ -131,8 +131,9 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
 
     bool isSymlink = file && file->isSymlink();
     bool isCut = index.data(FolderModel::FileIsCutRole).toBool();
-    // an emblem is added only to an untrusted, deletable desktop file that isn't inside applications directory
-    bool untrusted = file && !file->isTrustable() && file->isDesktopEntry() && file->isDeletable();
+    // an emblem is added only to an untrusted, deletable desktop file that isn't inside applications directory;
+    // the trust of a file whose metadata is pending is not read here, but once the model has refined it
+    bool untrusted = file && !file->isMetadataPending() && file->isDesktopEntry() && file->isDeletable() && !file->isTrustable();
     if (untrusted) {
         auto parentDir = QString::fromUtf8((file->dirPath().toString().get()));
         if(QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation).contains(parentDir)) {
@@ -21,6 +21,7 @@
 #include "foldermodel.h"
 #include <iostream>
 #include <algorithm>
+#include <iterator>
 #include <QtAlgorithms>
 #include <QVector>
 #include <qmimedata.h>
@@ -35,21 +36,23 @@
 #include <QClipboard>
 #include "utilities.h"
 #include "fileoperation.h"
+#include "core/thumbnailcache.h"
 
 namespace Fm {
 
+// when removing the ranges of rows one by one would move more items than this, counting the
+// mappings updated by the proxy models, the remaining rows are compacted at once in a reset
+static const size_t maxRemovalMoves = 4 * 1024 * 1024;
+
 FolderModel::FolderModel():
-    hasPendingThumbnailHandler_{false},
     showFullNames_{false},
     isLoaded_{false} {
     connect(QApplication::clipboard(), &QClipboard::dataChanged, this, &FolderModel::onClipboardDataChange);
+    connect(&thumbnailScheduler_, &Fm::ThumbnailScheduler::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded);
 }
 
 FolderModel::~FolderModel() {
-    // if the thumbnail requests list is not empty, cancel them
-    for(auto job: pendingThumbnailJobs_) {
-        job->cancel();
-    }
+    // the pending thumbnail requests are cancelled by thumbnailScheduler_
 }
 
 void FolderModel::setFolder(const std::shared_ptr<Fm::Folder>& new_folder) {
@@ -88,17 +91,18 @@ void FolderModel::onFinishLoading() {
 
 void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
     int n_files = files.size();
-    beginInsertRows(QModelIndex(), items.count(), items.count() + n_files - 1);
+    const int firstRow = items_.size();
+    beginInsertRows(QModelIndex(), firstRow, firstRow + n_files - 1);
     for(auto& info : files) {
-        FolderModelItem item(info);
         /*
             if(fm_file_info_is_hidden(info)) {
               model->hiddenItems.append(item);
               continue;
             }
         */
-        items.append(item);
+        appendRow(info);
     }
+    indexRows(firstRow);
     endInsertRows();
 
     if(isLoaded_) {
@@ -111,13 +115,22 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
         int row;
         auto& oldInfo = change.first;
         auto& newInfo = change.second;
-        QList<FolderModelItem>::iterator it = findItemByFileInfo(oldInfo.get(), &row);
-        if(it != items.end()) {
+        auto it = findItemByFileInfo(oldInfo.get(), &row);
+        if(it != items_.end()) {
             FolderModelItem& item = *it;
             // try to update the item
-            item.info = newInfo;
+            cancelLoadThumbnails(oldInfo.get());
+            if(newInfo->name() != oldInfo->name()) {
+                auto rowIt = rowsByName_.find(oldInfo->name());
+                if(rowIt != rowsByName_.end() && rowIt->second == row) {
+                    rowsByName_.erase(rowIt);
+                }
+                rowsByName_[newInfo->name()] = row;
+            }
+            setRowInfo(row, newInfo);
             item.thumbnails.clear();
-            QModelIndex index = createIndex(row, 0, &item);
+            rowSortKeys_[row] = nullptr;
+            QModelIndex index = createIndex(row, 0);
             Q_EMIT dataChanged(index, index);
             if(oldInfo->size() != newInfo->size()) {
                 Q_EMIT fileSizeChanged(index);
@@ -131,62 +144,207 @@ void FolderModel::onCutFilesChanged(std::vector<Fm::FileInfoPair>& files) {
         int row;
         auto& oldInfo = change.first;
         auto& newInfo = change.second;
-        QList<FolderModelItem>::iterator it = findItemByFileInfo(oldInfo.get(), &row);
-        if(it != items.end()) {
-            FolderModelItem& item = *it;
-            item.info = newInfo;
+        auto it = findItemByFileInfo(oldInfo.get(), &row);
+        if(it != items_.end()) {
+            setRowInfo(row, newInfo);
         }
     }
     Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, 0)); // update all items
 }
 
 void FolderModel::onFilesRemoved(const Fm::FileInfoList& files) {
+    std::vector<int> rows;
+    rows.reserve(files.size());
     for(auto& info : files) {
         int row;
-        QList<FolderModelItem>::iterator it = findItemByName(info->name().c_str(), &row);
-        if(it != items.end()) {
-            beginRemoveRows(QModelIndex(), row, row);
-            items.erase(it);
-            endRemoveRows();
+        auto it = findItemByName(info->name().c_str(), &row);
+        if(it != items_.end()) {
+            cancelLoadThumbnails(it->info.get());
+            rows.push_back(row);
         }
     }
+    if(!rows.empty()) {
+        removeRows(rows);
+    }
 }
 
-void FolderModel::loadPendingThumbnails() {
-    hasPendingThumbnailHandler_ = false;
-    for(auto& item: thumbnailData_) {
-        if(!item.pendingThumbnails_.empty()) {
-            auto job = new Fm::ThumbnailJob(std::move(item.pendingThumbnails_), item.size_);
-            pendingThumbnailJobs_.push_back(job);
-            job->setAutoDelete(true);
-            connect(job, &Fm::ThumbnailJob::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded, Qt::BlockingQueuedConnection);
-            connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished, Qt::BlockingQueuedConnection);
-            Fm::ThumbnailJob::threadPool()->start(job);
+// removes the rows in as few steps as possible
+void FolderModel::removeRows(std::vector<int>& rows) {
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    // the names of the removed rows are no longer indexed
+    for(int row: rows) {
+        auto rowIt = rowsByName_.find(items_[row].info->name());
+        if(rowIt != rowsByName_.end() && rowIt->second == row) {
+            rowsByName_.erase(rowIt);
+        }
+    }
+
+    const int oldCount = items_.size();
+    size_t rangeCount = 0;
+    for(size_t i = 0; i < rows.size(); ++i) {
+        if(i == 0 || rows[i] != rows[i - 1] + 1) {
+            ++rangeCount;
+        }
+    }
+    if(rangeCount * oldCount > maxRemovalMoves) {
+        // many scattered rows: the views lose their selections and scroll positions, but
+        // the rows kept are moved only once instead of once per range
+        beginResetModel();
+        auto removedIt = rows.cbegin();
+        int newRow = 0;
+        for(int row = 0; row < oldCount; ++row) {
+            if(removedIt != rows.cend() && *removedIt == row) {
+                ++removedIt;
+                continue;
+            }
+            if(newRow != row) {
+                items_[newRow] = std::move(items_[row]);
+                rowFlags_[newRow] = rowFlags_[row];
+                rowMtimes_[newRow] = rowMtimes_[row];
+                rowSizes_[newRow] = rowSizes_[row];
+                rowSortKeys_[newRow] = std::move(rowSortKeys_[row]);
+            }
+            ++newRow;
+        }
+        items_.erase(items_.begin() + newRow, items_.end());
+        rowFlags_.resize(newRow);
+        rowMtimes_.resize(newRow);
+        rowSizes_.resize(newRow);
+        rowSortKeys_.resize(newRow);
+        endResetModel();
+    }
+    else {
+        // the contiguous rows are removed together, from the last ones, so that the rows of
+        // the others are not changed
+        auto last = rows.crbegin();
+        while(last != rows.crend()) {
+            auto first = last;
+            while(std::next(first) != rows.crend() && *std::next(first) == *first - 1) {
+                ++first;
+            }
+            beginRemoveRows(QModelIndex(), *first, *last);
+            items_.erase(items_.begin() + *first, items_.begin() + *last + 1);
+            rowFlags_.erase(rowFlags_.begin() + *first, rowFlags_.begin() + *last + 1);
+            rowMtimes_.erase(rowMtimes_.begin() + *first, rowMtimes_.begin() + *last + 1);
+            rowSizes_.erase(rowSizes_.begin() + *first, rowSizes_.begin() + *last + 1);
+            rowSortKeys_.erase(rowSortKeys_.begin() + *first, rowSortKeys_.begin() + *last + 1);
+            endRemoveRows();
+            last = std::next(first);
         }
     }
+
+    // only the rows after the first removed one have moved
+    auto removedIt = rows.cbegin();
+    int newRow = rows.front();
+    for(int oldRow = rows.front(); oldRow < oldCount; ++oldRow) {
+        if(removedIt != rows.cend() && *removedIt == oldRow) {
+            ++removedIt;
+            continue;
+        }
+        auto rowIt = rowsByName_.find(items_[newRow].info->name());
+        if(rowIt != rowsByName_.end() && rowIt->second == oldRow) {
+            rowIt->second = newRow;
+        }
+        ++newRow;
+    }
 }
 
 void FolderModel::queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size) {
     auto it = std::find_if(thumbnailData_.begin(), thumbnailData_.end(), [size](ThumbnailData& item){return item.size_ == size;});
     if(it != thumbnailData_.end()) {
-        it->pendingThumbnails_.push_back(file);
-        if(!hasPendingThumbnailHandler_) {
-            QTimer::singleShot(0, this, &FolderModel::loadPendingThumbnails);
-            hasPendingThumbnailHandler_ = true;
+        auto priority = Fm::ThumbnailScheduler::Priority::NORMAL;
+        auto prioIt = thumbnailPriorities_.find(file.get());
+        if(prioIt != thumbnailPriorities_.cend()) {
+            priority = prioIt->second;
+        }
+        thumbnailScheduler_.request(file, size, priority);
+    }
+}
+
+// cancel the thumbnail requests of a file which is changed or removed
+void FolderModel::cancelLoadThumbnails(const Fm::FileInfo* file) {
+    for(auto& data: thumbnailData_) {
+        thumbnailScheduler_.cancel(file, data.size_);
+    }
+}
+
+void FolderModel::setThumbnailPriorities(const QModelIndexList& visibleIndexes, const QModelIndexList& prefetchIndexes) {
+    Fm::FileInfoList oldFiles = std::move(prioritizedFiles_);
+    prioritizedFiles_.clear();
+    thumbnailPriorities_.clear();
+    // the order of the indexes is kept among the requests of the same priority
+    auto prioritize = [this](const QModelIndexList& indexes, Fm::ThumbnailScheduler::Priority priority) {
+        for(const auto& index : indexes) {
+            FolderModelItem* item = itemFromIndex(index);
+            if(item && thumbnailPriorities_.emplace(item->info.get(), priority).second) {
+                prioritizedFiles_.push_back(item->info);
+                for(auto& data: thumbnailData_) {
+                    thumbnailScheduler_.setPriority(item->info.get(), data.size_, priority);
+                }
+            }
+        }
+    };
+    prioritize(visibleIndexes, Fm::ThumbnailScheduler::Priority::VISIBLE);
+    prioritize(prefetchIndexes, Fm::ThumbnailScheduler::Priority::PREFETCH);
+
+    // the items scrolled out of view; thumbnailFromIndex() requests them again when needed
+    for(auto& file: oldFiles) {
+        if(thumbnailPriorities_.find(file.get()) == thumbnailPriorities_.cend()) {
+            cancelLoadThumbnails(file.get());
         }
     }
 }
 
 void FolderModel::insertFiles(int row, const Fm::FileInfoList& files) {
     int n_files = files.size();
+    const int firstRow = items_.size();
     beginInsertRows(QModelIndex(), row, row + n_files - 1);
     for(auto& info : files) {
-        FolderModelItem item(info);
-        items.append(item);
+        appendRow(info);
     }
+    indexRows(firstRow);
     endInsertRows();
 }
 
+void FolderModel::appendRow(const std::shared_ptr<const Fm::FileInfo>& info) {
+    items_.emplace_back(info);
+    rowFlags_.push_back(0);
+    rowMtimes_.push_back(0);
+    rowSizes_.push_back(0);
+    rowSortKeys_.emplace_back();
+    setRowInfo(items_.size() - 1, info);
+}
+
+// sets the file info of a row and the fields of it used in sorting and filtering
+void FolderModel::setRowInfo(int row, const std::shared_ptr<const Fm::FileInfo>& info) {
+    items_[row].info = info;
+    quint8 flags = 0;
+    if(info->isDir()) {
+        flags |= RowIsDir;
+    }
+    if(info->isHidden()) {
+        flags |= RowIsHidden;
+    }
+    if(info->isBackup()) {
+        flags |= RowIsBackup;
+    }
+    rowFlags_[row] = flags;
+    rowMtimes_[row] = info->mtime();
+    rowSizes_[row] = info->size();
+}
+
+// adds the rows from firstRow to the end to rowsByName_
+void FolderModel::indexRows(int firstRow) {
+    const int n = items_.size();
+    rowsByName_.reserve(n);
+    for(int row = firstRow; row < n; ++row) {
+        // a duplicate name is found by the linear search of findItemByFileInfo()
+        rowsByName_.emplace(items_[row].info->name(), row);
+    }
+}
+
 void FolderModel::onClipboardDataChange() {
     if(folder_) {
         const QClipboard* clipboard = QApplication::clipboard();
@@ -232,11 +390,20 @@ void FolderModel::setCutFiles(const Fm::FilePathList& paths) {
 }
 
 void FolderModel::removeAll() {
-    if(items.empty()) {
+    if(items_.empty()) {
         return;
     }
-    beginRemoveRows(QModelIndex(), 0, items.size() - 1);
-    items.clear();
+    thumbnailScheduler_.cancelAll();
+    prioritizedFiles_.clear();
+    thumbnailPriorities_.clear();
+    beginRemoveRows(QModelIndex(), 0, items_.size() - 1);
+    // release the memory of a large folder
+    std::vector<FolderModelItem>().swap(items_);
+    std::vector<quint8>().swap(rowFlags_);
+    std::vector<quint64>().swap(rowMtimes_);
+    std::vector<quint64>().swap(rowSizes_);
+    std::vector<std::shared_ptr<const FolderModelItem::SortKeys>>().swap(rowSortKeys_);
+    rowsByName_.clear();
     endRemoveRows();
 }
 
@@ -244,7 +411,7 @@ int FolderModel::rowCount(const QModelIndex& parent) const {
     if(parent.isValid()) {
         return 0;
     }
-    return items.size();
+    return items_.size();
 }
 
 int FolderModel::columnCount(const QModelIndex& parent = QModelIndex()) const {
@@ -254,8 +421,21 @@ int FolderModel::columnCount(const QModelIndex& parent = QModelIndex()) const {
     return NumOfColumns;
 }
 
+void FolderModel::setShowFullName(bool fullName) {
+    if(fullName != showFullNames_) {
+        showFullNames_ = fullName;
+        // the names sorted are changed
+        for(auto& keys: rowSortKeys_) {
+            keys = nullptr;
+        }
+    }
+}
+
 FolderModelItem* FolderModel::itemFromIndex(const QModelIndex& index) const {
-    return reinterpret_cast<FolderModelItem*>(index.internalPointer());
+    if(!index.isValid() || index.row() >= int(items_.size())) {
+        return nullptr;
+    }
+    return const_cast<FolderModelItem*>(&items_[index.row()]);
 }
 
 std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromIndex(const QModelIndex& index) const {
@@ -294,7 +474,7 @@ QString FolderModel::makeTooltip(FolderModelItem* item) const {
 }
 
 QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRole*/) const {
-    if(!index.isValid() || index.row() > items.size() || index.column() >= NumOfColumns) {
+    if(!index.isValid() || index.row() >= int(items_.size()) || index.column() >= NumOfColumns) {
         return QVariant();
     }
     FolderModelItem* item = itemFromIndex(index);
@@ -331,6 +511,11 @@ QVariant FolderModel::data(const QModelIndex& index, int role/* = Qt::DisplayRol
     }
     case Qt::DecorationRole: {
         if(index.column() == 0) {
+            // the item is being shown; check its content if its type is only a guess,
+            // and read its emblems if they were not
+            if(folder_ && Q_UNLIKELY(info->isMimeTypeGuessed() || info->isMetadataPending())) {
+                folder_->refineFileInfo(info);
+            }
             return QVariant(item->icon(isCut));
         }
         break;
@@ -385,11 +570,10 @@ QVariant FolderModel::headerData(int section, Qt::Orientation orientation, int r
 }
 
 QModelIndex FolderModel::index(int row, int column, const QModelIndex& /*parent*/) const {
-    if(row < 0 || row >= items.size() || column < 0 || column >= NumOfColumns) {
+    if(row < 0 || row >= int(items_.size()) || column < 0 || column >= NumOfColumns) {
         return QModelIndex();
     }
-    const FolderModelItem& item = items.at(row);
-    return createIndex(row, column, (void*)&item);
+    return createIndex(row, column);
 }
 
 QModelIndex FolderModel::parent(const QModelIndex& /*index*/) const {
@@ -413,8 +597,16 @@ Qt::ItemFlags FolderModel::flags(const QModelIndex& index) const {
 }
 
 std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromPath(const Fm::FilePath& path) const {
-    QList<FolderModelItem>::const_iterator it = items.begin();
-    while(it != items.end()) {
+    // usually a file of the folder, found by its name
+    auto baseName = path.baseName();
+    if(baseName) {
+        auto rowIt = rowsByName_.find(baseName.get());
+        if(rowIt != rowsByName_.cend() && items_[rowIt->second].info->path() == path) {
+            return items_[rowIt->second].info;
+        }
+    }
+    auto it = items_.cbegin();
+    while(it != items_.cend()) {
         const FolderModelItem& item = *it;
         if(item.info->path() == path) {
             return item.info;
@@ -424,27 +616,25 @@ std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromPath(const Fm::File
     return nullptr;
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while(it != items.end()) {
-        FolderModelItem& item = *it;
-        if(item.info->name() == name) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+std::vector<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
+    auto rowIt = rowsByName_.find(name);
+    if(rowIt == rowsByName_.cend()) {
+        return items_.end();
     }
-    return items.end();
+    *row = rowIt->second;
+    return items_.begin() + rowIt->second;
 }
 
-QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
+std::vector<FolderModelItem>::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
+    auto rowIt = rowsByName_.find(info->name());
+    if(rowIt != rowsByName_.cend() && items_[rowIt->second].info.get() == info) {
+        *row = rowIt->second;
+        return items_.begin() + rowIt->second;
+    }
+    // not the first file with its name, or the name has changed
+    auto it = items_.begin();
     int i = 0;
-    while(it != items.end()) {
+    while(it != items_.end()) {
         FolderModelItem& item = *it;
         if(item.info.get() == info) {
             *row = i;
@@ -453,7 +643,7 @@ QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(const Fm::Fil
         ++it;
         ++i;
     }
-    return items.end();
+    return items_.end();
 }
 
 QStringList FolderModel::mimeTypes() const {
@@ -598,13 +788,12 @@ void FolderModel::releaseThumbnails(int size) {
         if(it->size_ == size) {
             --it->refCount_;
             if(it->refCount_ == 0) {
+                thumbnailScheduler_.cancelSize(size);
                 thumbnailData_.erase_after(prev);
             }
 
             // remove all cached thumbnails of the specified size
-            QList<FolderModelItem>::iterator itemIt;
-            for(itemIt = items.begin(); itemIt != items.end(); ++itemIt) {
-                FolderModelItem& item = *itemIt;
+            for(auto& item: items_) {
                 item.removeThumbnail(size);
             }
             break;
@@ -613,25 +802,39 @@ void FolderModel::releaseThumbnails(int size) {
     }
 }
 
-void FolderModel::onThumbnailJobFinished() {
-    Fm::ThumbnailJob* job = static_cast<Fm::ThumbnailJob*>(sender());
-    auto it = std::find(pendingThumbnailJobs_.cbegin(), pendingThumbnailJobs_.cend(), job);
-    if(it != pendingThumbnailJobs_.end()) {
-        pendingThumbnailJobs_.erase(it);
+// free the cached thumbnails of the specified size of some items only, those scrolled far away
+void FolderModel::releaseThumbnails(const QModelIndexList& indexes, int size) {
+    auto it = std::find_if(thumbnailData_.begin(), thumbnailData_.end(), [size](ThumbnailData& item){return item.size_ == size;});
+    // other views may show these items
+    if(it == thumbnailData_.end() || it->refCount_ > 1) {
+        return;
+    }
+    for(const auto& index: indexes) {
+        FolderModelItem* item = itemFromIndex(index);
+        if(item) {
+            // thumbnailFromIndex() finds it in the thumbnail cache or loads it again when needed
+            thumbnailScheduler_.cancel(item->info.get(), size);
+            item->removeThumbnail(size);
+        }
     }
 }
 
-void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image) {
+void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image, const QImage& transparentImage) {
     // find the model item this thumbnail belongs to
     int row;
-    QList<FolderModelItem>::iterator it = findItemByFileInfo(file.get(), &row);
-    if(it != items.end()) {
+    auto it = findItemByFileInfo(file.get(), &row);
+    if(it != items_.end()) {
         // the file is found in our model
         FolderModelItem& item = *it;
-        QModelIndex index = createIndex(row, 0, (void*)&item);
+        QModelIndex index = createIndex(row, 0);
+        // drop an outdated transparent variant
+        item.thumbnails.erase(std::remove_if(item.thumbnails.begin(), item.thumbnails.end(), [size](const FolderModelItem::Thumbnail& thumb) {
+            return thumb.size == size && thumb.transparent;
+        }), item.thumbnails.end());
         // store the image in the folder model item.
         FolderModelItem::Thumbnail* thumbnail = item.findThumbnail(size, false);
         thumbnail->image = image;
+        thumbnail->pixmap = QPixmap();
         thumbnail->transparent = false;
         // qDebug("thumbnail loaded for: %s, size: %d", item.displayName.toUtf8().constData(), size);
         if(image.isNull()) {
@@ -640,6 +843,15 @@ void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& f
         else {
             thumbnail->status = FolderModelItem::ThumbnailLoaded;
             thumbnail->image = image;
+            if(!transparentImage.isNull()) {
+                // the variant made by the job, used for cut files
+                FolderModelItem::Thumbnail transThumb;
+                transThumb.status = FolderModelItem::ThumbnailLoaded;
+                transThumb.image = transparentImage;
+                transThumb.size = size;
+                transThumb.transparent = true;
+                item.thumbnails.append(transThumb);
+            }
 
             // tell the world that we have the thumbnail loaded
             Q_EMIT thumbnailLoaded(index, size);
@@ -647,27 +859,59 @@ void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& f
     }
 }
 
-// get a thumbnail of size at the index
+// get the thumbnail of size at the index, or nullptr if it is not loaded yet.
 // if a thumbnail is not yet loaded, this will initiate loading of the thumbnail.
-QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
+FolderModelItem::Thumbnail* FolderModel::loadedThumbnail(const QModelIndex& index, int size) {
     FolderModelItem* item = itemFromIndex(index);
     if(item) {
         FolderModelItem::Thumbnail* thumbnail = item->findThumbnail(size, item->isCut());
         // qDebug("FolderModel::thumbnailFromIndex: %d, %s", thumbnail->status, item->displayName.toUtf8().data());
         switch(thumbnail->status) {
         case FolderModelItem::ThumbnailNotChecked: {
+            // the thumbnail may be cached already by another model or before a reload
+            QImage image = Fm::ThumbnailCache::globalInstance()->find(*item->info, size);
+            if(!image.isNull()) {
+                thumbnail->status = FolderModelItem::ThumbnailLoaded;
+                thumbnail->image = image;
+                // get the transparent variant of a cut file
+                return item->findThumbnail(size, item->isCut());
+            }
             // load the thumbnail
             queueLoadThumbnail(item->info, size);
             thumbnail->status = FolderModelItem::ThumbnailLoading;
             break;
         }
+        case FolderModelItem::ThumbnailLoading:
+            // the request is cancelled when the item is scrolled out of view
+            if(!thumbnailScheduler_.isPending(item->info.get(), size)) {
+                queueLoadThumbnail(item->info, size);
+            }
+            break;
         case FolderModelItem::ThumbnailLoaded:
-            return thumbnail->image;
+            return thumbnail;
         default:
             ;
         }
     }
-    return QImage();
+    return nullptr;
+}
+
+QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
+    FolderModelItem::Thumbnail* thumbnail = loadedThumbnail(index, size);
+    return thumbnail ? thumbnail->image : QImage();
+}
+
+// the thumbnails are premultiplied by the thumbnail jobs, so making a pixmap of one only
+// copies it, and it is done once rather than by the item delegate at every paint
+QPixmap FolderModel::thumbnailPixmapFromIndex(const QModelIndex& index, int size) {
+    FolderModelItem::Thumbnail* thumbnail = loadedThumbnail(index, size);
+    if(!thumbnail) {
+        return QPixmap();
+    }
+    if(thumbnail->pixmap.isNull()) {
+        thumbnail->pixmap = QPixmap::fromImage(thumbnail->image);
+    }
+    return thumbnail->pixmap;
 }
 
 
@@ -30,10 +30,12 @@
 #include <vector>
 #include <utility>
 #include <forward_list>
+#include <unordered_map>
 #include "foldermodelitem.h"
 
 #include "core/folder.h"
 #include "core/thumbnailjob.h"
+#include "core/thumbnailscheduler.h"
 
 namespace Fm {
 
@@ -47,6 +49,13 @@ public:
         FileIsCutRole
     };
 
+    // the file properties compared by ProxyFolderModel, see rowFlags()
+    enum RowFlag {
+        RowIsDir = 1 << 0,
+        RowIsHidden = 1 << 1,
+        RowIsBackup = 1 << 2
+    };
+
     enum ColumnId {
         ColumnFileName,
         ColumnFileType,
@@ -91,12 +100,35 @@ public:
     std::shared_ptr<const Fm::FileInfo> fileInfoFromPath(const Fm::FilePath& path) const;
     FolderModelItem* itemFromIndex(const QModelIndex& index) const;
     QImage thumbnailFromIndex(const QModelIndex& index, int size);
+    QPixmap thumbnailPixmapFromIndex(const QModelIndex& index, int size);
 
     void cacheThumbnails(int size);
     void releaseThumbnails(int size);
+    void releaseThumbnails(const QModelIndexList& indexes, int size);
+
+    // thumbnails of the visible items are loaded first, then the ones of the prefetched items;
+    // requests for the items given before but not anymore are cancelled
+    void setThumbnailPriorities(const QModelIndexList& visibleIndexes, const QModelIndexList& prefetchIndexes);
+
+    void setShowFullName(bool fullName);
+
+    // the fields used in sorting and filtering are kept in arrays indexed by row rather than
+    // in the items, so that scanning the rows does not go through the file infos
+    quint8 rowFlags(int row) const {
+        return rowFlags_[row];
+    }
 
-    void setShowFullName(bool fullName) {
-        showFullNames_ = fullName;
+    quint64 rowMtime(int row) const {
+        return rowMtimes_[row];
+    }
+
+    quint64 rowSize(int row) const {
+        return rowSizes_[row];
+    }
+
+    // the collation keys cached by ProxyFolderModel, reset when the file info changes
+    std::shared_ptr<const FolderModelItem::SortKeys>& rowSortKeys(int row) const {
+        return rowSortKeys_[row];
     }
 
 Q_SIGNALS:
@@ -113,18 +145,22 @@ protected Q_SLOTS:
     void onCutFilesChanged(std::vector<Fm::FileInfoPair>& files);
     void onFilesRemoved(const Fm::FileInfoList& files);
 
-    void onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image);
-    void onThumbnailJobFinished();
-    void loadPendingThumbnails();
+    void onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& file, int size, const QImage& image, const QImage& transparentImage);
 
     void onClipboardDataChange();
 
 protected:
     void queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size);
+    FolderModelItem::Thumbnail* loadedThumbnail(const QModelIndex& index, int size);
+    void cancelLoadThumbnails(const Fm::FileInfo* file);
     void insertFiles(int row, const Fm::FileInfoList& files);
     void removeAll();
-    QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
-    QList<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
+    std::vector<FolderModelItem>::iterator findItemByName(const char* name, int* row);
+    std::vector<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
+    void appendRow(const std::shared_ptr<const Fm::FileInfo>& info);
+    void setRowInfo(int row, const std::shared_ptr<const Fm::FileInfo>& info);
+    void indexRows(int firstRow);
+    void removeRows(std::vector<int>& rows);
 
 private:
     void setCutFiles(const Fm::FilePathList& paths);
@@ -140,15 +176,25 @@ private:
 
         int size_;
         int refCount_;
-        Fm::FileInfoList pendingThumbnails_;
     };
 
     std::shared_ptr<Fm::Folder> folder_;
-    QList<FolderModelItem> items;
-
-    bool hasPendingThumbnailHandler_;
-    std::vector<Fm::ThumbnailJob*> pendingThumbnailJobs_;
+    // the items are stored contiguously and found by the rows of the indexes, which are
+    // updated by Qt when rows are inserted or removed, rather than by pointers
+    std::vector<FolderModelItem> items_;
+    // the hot fields of each row, see rowFlags()
+    std::vector<quint8> rowFlags_;
+    std::vector<quint64> rowMtimes_;
+    std::vector<quint64> rowSizes_;
+    mutable std::vector<std::shared_ptr<const FolderModelItem::SortKeys>> rowSortKeys_;
+    // the row of each file name, so that the files changed or removed are found at once
+    std::unordered_map<std::string, int> rowsByName_;
+
+    Fm::ThumbnailScheduler thumbnailScheduler_;
     std::forward_list<ThumbnailData> thumbnailData_;
+    // the files given to setThumbnailPriorities()
+    Fm::FileInfoList prioritizedFiles_;
+    std::unordered_map<const Fm::FileInfo*, Fm::ThumbnailScheduler::Priority> thumbnailPriorities_;
 
     bool showFullNames_;
 
@@ -20,15 +20,15 @@
 
 #include "foldermodelitem.h"
 #include <QDateTime>
-#include <QPainter>
+#include <algorithm>
 #include "utilities.h"
 #include "core/userinfocache.h"
+#include "core/thumbnailjob.h"
 
 namespace Fm {
 
 FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info):
     info{_info} {
-    thumbnails.reserve(2);
 }
 
 FolderModelItem::FolderModelItem(const FolderModelItem& other):
@@ -94,7 +94,7 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size, bool transp
             }
             else { // it->status == ThumbnailLoaded
                 if(it->transparent == false && transparent == true
-                        && size < 48 /* (dirty) needed only for 'compact' and 'details list' view */ ) {
+                        && ThumbnailJob::needsTransparentVariant(size)) {
                     transThumb = it; // save thumb to add transparency later
                 }
                 else {
@@ -104,18 +104,8 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size, bool transp
         }
     }
     if(transThumb) {
-        QImage image(transThumb->image);
-
-        if(!image.hasAlphaChannel()) {
-            image = image.convertToFormat(QImage::Format_ARGB32);
-        }
-
-        // add transparency to image
-        QPainter p;
-        p.begin(&image);
-        p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-        p.fillRect(image.rect(), QColor(0, 0, 0, 115 /* alpha 45% */));
-        p.end();
+        // usually made by the thumbnail job already, but not if the file is cut after that
+        QImage image = ThumbnailJob::makeTransparent(transThumb->image);
 
         // add image to thumbnails
         Thumbnail thumbnail;
@@ -135,15 +125,11 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size, bool transp
     return &thumbnails.back();
 }
 
-// remove cached thumbnail of the specified size
+// remove cached thumbnails of the specified size, the transparent variant included
 void FolderModelItem::removeThumbnail(int size) {
-    QVector<Thumbnail>::iterator it;
-    for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
-        if(it->size == size) { // an image of the same size is found
-            thumbnails.erase(it);
-            break;
-        }
-    }
+    thumbnails.erase(std::remove_if(thumbnails.begin(), thumbnails.end(), [size](const Thumbnail& thumbnail) {
+        return thumbnail.size == size;
+    }), thumbnails.end());
 }
 
 
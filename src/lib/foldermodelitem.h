@@ -23,9 +23,14 @@
 
 #include "libfmqtglobals.h"
 #include <QImage>
+#include <QPixmap>
 #include <QString>
 #include <QIcon>
 #include <QVector>
+#include <QCollator>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "core/folder.h"
 
@@ -46,13 +51,43 @@ public:
         bool transparent;
         ThumbnailStatus status;
         QImage image;
+        QPixmap pixmap; // made from image when it is painted first
+    };
+
+    // collation keys cached by ProxyFolderModel, so that sorting does not collate strings;
+    // they are stored by FolderModel along with the other fields used in sorting
+    struct SortKeys {
+        SortKeys(quint64 gen, QCollatorSortKey dispNameKey):
+            generation{gen},
+            nameKey{std::move(dispNameKey)} {
+        }
+
+        // nullptr if it is not made yet
+        const QCollatorSortKey* columnKey(int column) const {
+            for(const auto& key: columnKeys) {
+                if(key.first == column) {
+                    return &key.second;
+                }
+            }
+            return nullptr;
+        }
+
+        quint64 generation; // identifies the collator settings they are made with
+        QCollatorSortKey nameKey; // of the display name
+        // of the texts shown in the columns sorted by, kept for all of them so that the views
+        // sharing the model and sorted by different columns do not replace each other's keys
+        std::vector<std::pair<int, QCollatorSortKey>> columnKeys;
     };
 
 public:
     explicit FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info);
     FolderModelItem(const FolderModelItem& other);
+    FolderModelItem(FolderModelItem&& other) = default;
     virtual ~FolderModelItem();
 
+    FolderModelItem& operator=(const FolderModelItem& other) = default;
+    FolderModelItem& operator=(FolderModelItem&& other) = default;
+
     const QString& displayName() const {
         return info->displayName();
     }
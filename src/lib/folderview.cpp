@@ -52,6 +52,7 @@
 #include "utilities.h"
 
 #include <algorithm>
+#include <unordered_set>
 
 #define SCROLL_FRAMES_PER_SEC 50
 #define SCROLL_DURATION 300 // in ms
@@ -859,6 +860,8 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
     autoSelectionDelay_(600),
     autoSelectionTimer_(nullptr),
     selChangedTimer_(nullptr),
+    visibleRowsTimer_(nullptr),
+    lastFirstVisibleRow_(-1),
     itemDelegateMargins_(QSize(3, 3)),
     shadowHidden_(false),
     ctrlRightClick_(false),
@@ -873,6 +876,11 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget *parent):
     layout->setMargin(0);
     setLayout(layout);
 
+    visibleRowsTimer_ = new QTimer(this);
+    visibleRowsTimer_->setSingleShot(true);
+    visibleRowsTimer_->setInterval(50);
+    connect(visibleRowsTimer_, &QTimer::timeout, this, &FolderView::onVisibleRowsTimeout);
+
     setViewMode(_mode);
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 
@@ -963,6 +971,59 @@ void FolderView::onSelectionChanged(const QItemSelection& /*selected*/, const QI
     }
 }
 
+void FolderView::queueVisibleRowsUpdate() {
+    // not restarted, so that it also times out during a continuous scrolling
+    if(!visibleRowsTimer_->isActive()) {
+        visibleRowsTimer_->start();
+    }
+}
+
+void FolderView::onVisibleRowsTimeout() {
+    if(!view || !model_ || !model_->showThumbnails() || model_->rowCount() == 0) {
+        return;
+    }
+    // find the first and last items shown in the viewport by sampling it
+    const QRect rect = view->viewport()->rect();
+    const int step = qMax(view->iconSize().height() / 2, 8);
+    QModelIndex first, last;
+    for(int y = rect.top(); y <= rect.bottom() && !first.isValid(); y += step) {
+        for(int x = rect.left(); x <= rect.right() && !first.isValid(); x += step) {
+            first = view->indexAt(QPoint(x, y));
+        }
+    }
+    if(!first.isValid()) {
+        return;
+    }
+    for(int y = rect.bottom(); y >= rect.top() && !last.isValid(); y -= step) {
+        for(int x = rect.right(); x >= rect.left() && !last.isValid(); x -= step) {
+            last = view->indexAt(QPoint(x, y));
+        }
+    }
+    int firstRow = first.row();
+    int lastRow = last.isValid() ? qMax(last.row(), firstRow) : firstRow;
+    // the samples may miss the items at the edges
+    while(firstRow > 0 && view->visualRect(model_->index(firstRow - 1, 0)).intersects(rect)) {
+        --firstRow;
+    }
+    int rowCount = model_->rowCount();
+    while(lastRow < rowCount - 1 && view->visualRect(model_->index(lastRow + 1, 0)).intersects(rect)) {
+        ++lastRow;
+    }
+
+    // the scrolling speed in rows per second, which tells the model how far to prefetch
+    int velocity = 0;
+    if(lastFirstVisibleRow_ >= 0 && lastVisibleRowsTime_.isValid()) {
+        qint64 elapsed = lastVisibleRowsTime_.elapsed();
+        // the view was not scrolled for a while otherwise
+        if(elapsed > 0 && elapsed < 1000) {
+            velocity = int((firstRow - lastFirstVisibleRow_) * 1000 / elapsed);
+        }
+    }
+    lastFirstVisibleRow_ = firstRow;
+    lastVisibleRowsTime_.start();
+    model_->setVisibleRows(firstRow, lastRow, velocity);
+}
+
 void FolderView::onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint) {
     if (hint != QAbstractItemDelegate::NoHint) {
         // we set the hint to NoHint in FolderItemDelegate::eventFilter()
@@ -1137,6 +1198,11 @@ void FolderView::setViewMode(ViewMode _mode) {
         // inline renaming
         connect(delegate, &QAbstractItemDelegate::closeEditor, this, &FolderView::onClosingEditor);
 
+        // let the model load the thumbnails of the visible items first
+        connect(view->verticalScrollBar(), &QScrollBar::valueChanged, this, &FolderView::queueVisibleRowsUpdate, Qt::UniqueConnection);
+        connect(view->horizontalScrollBar(), &QScrollBar::valueChanged, this, &FolderView::queueVisibleRowsUpdate, Qt::UniqueConnection);
+        queueVisibleRowsUpdate();
+
         if(model_) {
             // FIXME: preserve selections
             model_->setThumbnailSize(iconSize.width());
@@ -1275,6 +1341,13 @@ void FolderView::setModel(ProxyFolderModel* model) {
         delete model_;
     }
     model_ = model;
+    lastFirstVisibleRow_ = -1; // the next report is not a scroll
+    if(model_) {
+        connect(model_, &QAbstractItemModel::rowsInserted, this, &FolderView::queueVisibleRowsUpdate);
+        connect(model_, &QAbstractItemModel::layoutChanged, this, &FolderView::queueVisibleRowsUpdate);
+        connect(model_, &QAbstractItemModel::modelReset, this, &FolderView::queueVisibleRowsUpdate);
+        queueVisibleRowsUpdate();
+    }
 }
 
 bool FolderView::event(QEvent* event) {
@@ -1407,35 +1480,54 @@ void FolderView::selectFiles(const Fm::FileInfoList& files, bool add) {
     if(!add) {
         selectionModel()->clear();
     }
-    QModelIndex index, firstIndex;
-    int count = model_->rowCount();
-    Fm::FileInfoList list = files;
-    bool singleFile(files.size() == 1);
-    QItemSelectionModel::SelectionFlags flags = QItemSelectionModel::Select;
-    if(mode == DetailedListMode) {
-        flags |= QItemSelectionModel::Rows;
+    FolderModel* srcModel = static_cast<FolderModel*>(model_->sourceModel());
+    if(!srcModel) {
+        return;
     }
-    for(int row = 0; row < count; ++row) {
-        if (list.empty()) {
-            break;
+    // the rows of the files are found in one pass over the proxy rows, and the contiguous
+    // ones are merged into ranges, so that the selection model is updated only once
+    std::unordered_set<const Fm::FileInfo*> targets;
+    targets.reserve(files.size());
+    for(auto& file : files) {
+        targets.insert(file.get());
+    }
+    QItemSelection selection;
+    QModelIndex firstIndex;
+    int runFirst = -1, runLast = -1;
+    size_t found = 0;
+    int count = model_->rowCount();
+    for(int row = 0; row < count && found < targets.size(); ++row) {
+        QModelIndex index = model_->index(row, 0);
+        FolderModelItem* item = srcModel->itemFromIndex(model_->mapToSource(index));
+        if(!item || targets.find(item->info.get()) == targets.cend()) {
+            continue;
         }
-        index = model_->index(row, 0);
-        auto info = model_->fileInfoFromIndex(index);
-        for(auto it = list.cbegin(); it != list.cend(); ++it) {
-            auto& item = *it;
-            if(item == info) {
-                selectionModel()->select(index, flags);
-                if (!firstIndex.isValid()) {
-                    firstIndex = index;
-                }
-                list.erase(it);
-                break;
+        ++found;
+        if(!firstIndex.isValid()) {
+            firstIndex = index;
+        }
+        if(runFirst >= 0 && runLast == row - 1) {
+            runLast = row;
+        }
+        else {
+            if(runFirst >= 0) {
+                selection.select(model_->index(runFirst, 0), model_->index(runLast, 0));
             }
+            runFirst = runLast = row;
         }
     }
-    if (firstIndex.isValid()) {
+    if(runFirst >= 0) {
+        selection.select(model_->index(runFirst, 0), model_->index(runLast, 0));
+    }
+
+    if(firstIndex.isValid()) {
+        QItemSelectionModel::SelectionFlags flags = QItemSelectionModel::Select;
+        if(mode == DetailedListMode) {
+            flags |= QItemSelectionModel::Rows;
+        }
+        selectionModel()->select(selection, flags);
         view->scrollTo(firstIndex, QAbstractItemView::EnsureVisible);
-        if (singleFile) { // give focus to the single file
+        if(files.size() == 1) { // give focus to the single file
             selectionModel()->setCurrentIndex(firstIndex, QItemSelectionModel::Current);
         }
     }
@@ -1604,6 +1696,9 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
                 setCursor(Qt::ArrowCursor);
             }
             break;
+        case QEvent::Resize:
+            queueVisibleRowsUpdate();
+            break;
         case QEvent::Wheel:
             // don't let the view scroll during an inline renaming
             if (view) {
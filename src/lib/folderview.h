@@ -26,6 +26,7 @@
 #include <QListView>
 #include <QTreeView>
 #include <QMouseEvent>
+#include <QElapsedTimer>
 #include "foldermodel.h"
 #include "proxyfoldermodel.h"
 
@@ -171,6 +172,8 @@ public Q_SLOTS:
 private Q_SLOTS:
     void onAutoSelectionTimeout();
     void onSelChangedTimeout();
+    void queueVisibleRowsUpdate();
+    void onVisibleRowsTimeout();
     void onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint);
     void scrollSmoothly();
 
@@ -195,6 +198,11 @@ private:
     QTimer* autoSelectionTimer_;
     QModelIndex lastAutoSelectionIndex_;
     QTimer* selChangedTimer_;
+    // reports the visible rows to the model when the view is scrolled or resized
+    QTimer* visibleRowsTimer_;
+    // the first visible row last reported, and when, to measure the scrolling speed
+    int lastFirstVisibleRow_;
+    QElapsedTimer lastVisibleRowsTime_;
     // the cell margins in the icon and thumbnail modes
     QSize itemDelegateMargins_;
     bool shadowHidden_;
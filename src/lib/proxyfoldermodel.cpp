@@ -20,26 +20,243 @@
 
 #include "proxyfoldermodel.h"
 #include "foldermodel.h"
+#include "foldermodelitem.h"
+#include "core/thumbnailcache.h"
+#include "core/jobexecutor.h"
 #include <QCollator>
+#include <QThread>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
 
 namespace Fm {
 
+// folders with fewer files are sorted in the GUI thread, which takes less than a few frames
+static const int backgroundSortMinRows = 10000;
+
+// the numeric columns are not collated, but the display names are when the numbers are equal
+static int sortKeyColumn(int column) {
+    return column == FolderModel::ColumnFileMTime || column == FolderModel::ColumnFileSize
+           ? int(FolderModel::ColumnFileName) : column;
+}
+
+// the proxy models with the same collator settings get the same generation, so that the ones
+// sorting the same folder model (tabs, split views, the cached models) share the keys cached in it;
+// only called in the GUI thread
+static quint64 sortKeyGeneration(const QCollator& collator) {
+    static std::map<std::tuple<QString, int, bool, bool>, quint64> generations;
+    auto settings = std::make_tuple(collator.locale().bcp47Name(), int(collator.caseSensitivity()),
+                                    collator.numericMode(), collator.ignorePunctuation());
+    return generations.emplace(settings, generations.size() + 1).first->second;
+}
+
+namespace {
+
+// sorts the rows of a folder model in the order of ProxyFolderModel::lessThan() with a parallel merge sort
+class SortJob: public Job {
+public:
+    struct Entry {
+        int row; // in the source model
+        // keeps the file alive, so that it still identifies the row when rows were added or removed
+        std::shared_ptr<const FileInfo> info;
+        bool isDir;
+        bool isHidden;
+        quint64 mtime;
+        quint64 size;
+        // the texts to collate if keys is not made yet
+        QString text;
+        QString displayName;
+        std::shared_ptr<const FolderModelItem::SortKeys> keys;
+        const QCollatorSortKey* columnKey; // in keys, once it is made
+    };
+
+    explicit SortJob(std::vector<Entry> entries, quint64 sourceVersion, const QCollator& collator, quint64 generation,
+                     int column, Qt::SortOrder order, bool folderFirst, bool hiddenLast):
+        entries_{std::move(entries)},
+        sourceVersion_{sourceVersion},
+        collator_{collator},
+        generation_{generation},
+        column_{column},
+        order_{order},
+        folderFirst_{folderFirst},
+        hiddenLast_{hiddenLast} {
+        setExecutionClass(ExecutionClass::INTERACTIVE);
+    }
+
+    // in the sorted order once it is finished
+    std::vector<Entry>& entries() {
+        return entries_;
+    }
+
+    quint64 sourceVersion() const {
+        return sourceVersion_;
+    }
+
+    quint64 generation() const {
+        return generation_;
+    }
+
+    int column() const {
+        return column_;
+    }
+
+    Qt::SortOrder order() const {
+        return order_;
+    }
+
+    bool folderFirst() const {
+        return folderFirst_;
+    }
+
+    bool hiddenLast() const {
+        return hiddenLast_;
+    }
+
+protected:
+    void exec() override {
+        const int n = int(entries_.size());
+        // the parts are run by the pool of the job, which bounds the number of threads
+        const int threadCount = qBound(1, QThread::idealThreadCount(), 8);
+        auto executor = JobExecutor::globalInstance();
+        auto chunkBegin = [n, threadCount](int i) {
+            return int(qint64(n) * i / threadCount);
+        };
+
+        // make the missing collation keys, with a collator per thread
+        const int keyColumn = sortKeyColumn(column_);
+        executor->runInParallel(executionClass(), threadCount, [&](int i) {
+            QCollator collator{collator_.locale()};
+            collator.setCaseSensitivity(collator_.caseSensitivity());
+            collator.setNumericMode(collator_.numericMode());
+            collator.setIgnorePunctuation(collator_.ignorePunctuation());
+            for(int j = chunkBegin(i); j < chunkBegin(i + 1) && !isCancelled(); ++j) {
+                auto& entry = entries_[j];
+                if(!entry.keys || !entry.keys->columnKey(keyColumn)) {
+                    auto keys = entry.keys ? std::make_shared<FolderModelItem::SortKeys>(*entry.keys)
+                                : std::make_shared<FolderModelItem::SortKeys>(generation_, collator.sortKey(entry.displayName));
+                    keys->columnKeys.emplace_back(keyColumn, collator.sortKey(entry.text));
+                    entry.keys = std::move(keys);
+                }
+                entry.columnKey = entry.keys->columnKey(keyColumn);
+            }
+        });
+
+        // sort a chunk in each thread, then merge neighbouring chunks in parallel until one is left
+        std::vector<int> order(n);
+        for(int i = 0; i < n; ++i) {
+            order[i] = i;
+        }
+        auto less = [this](int a, int b) {
+            return lessThan(entries_[a], entries_[b]);
+        };
+        executor->runInParallel(executionClass(), threadCount, [&](int i) {
+            if(!isCancelled()) {
+                std::sort(order.begin() + chunkBegin(i), order.begin() + chunkBegin(i + 1), less);
+            }
+        });
+        for(int width = 1; width < threadCount && !isCancelled(); width *= 2) {
+            std::vector<int> firstChunks;
+            for(int i = 0; i + width < threadCount; i += 2 * width) {
+                firstChunks.push_back(i);
+            }
+            executor->runInParallel(executionClass(), int(firstChunks.size()), [&](int k) {
+                int i = firstChunks[k];
+                std::inplace_merge(order.begin() + chunkBegin(i),
+                                   order.begin() + chunkBegin(i + width),
+                                   order.begin() + chunkBegin(std::min(i + 2 * width, threadCount)),
+                                   less);
+            });
+        }
+        if(isCancelled()) {
+            return;
+        }
+
+        std::vector<Entry> sorted;
+        sorted.reserve(n);
+        for(int i: order) {
+            sorted.emplace_back(std::move(entries_[i]));
+        }
+        entries_ = std::move(sorted);
+    }
+
+private:
+    // must give the same order as ProxyFolderModel::lessThan()
+    bool lessThan(const Entry& left, const Entry& right) const {
+        if(folderFirst_ && left.isDir != right.isDir) {
+            return order_ == Qt::AscendingOrder ? left.isDir : right.isDir;
+        }
+        if(hiddenLast_ && left.isHidden != right.isHidden) {
+            return order_ == Qt::AscendingOrder ? right.isHidden : left.isHidden;
+        }
+        int comp = 0;
+        switch(column_) {
+        case FolderModel::ColumnFileMTime:
+            if(left.mtime != right.mtime) {
+                return left.mtime < right.mtime;
+            }
+            break;
+        case FolderModel::ColumnFileSize:
+            if(left.size != right.size) {
+                return left.size < right.size;
+            }
+            break;
+        default:
+            comp = left.columnKey->compare(*right.columnKey);
+            break;
+        }
+        if(comp == 0) {
+            comp = left.keys->nameKey.compare(right.keys->nameKey);
+        }
+        if(comp == 0) {
+            return left.info->name() < right.info->name();
+        }
+        return comp < 0;
+    }
+
+private:
+    std::vector<Entry> entries_;
+    quint64 sourceVersion_;
+    QCollator collator_;
+    quint64 generation_;
+    int column_;
+    Qt::SortOrder order_;
+    bool folderFirst_;
+    bool hiddenLast_;
+};
+
+} // namespace
+
 ProxyFolderModel::ProxyFolderModel(QObject* parent):
     QSortFilterProxyModel(parent),
+    sortKeyGeneration_(0),
     showHidden_(false),
     backupAsHidden_(true),
     folderFirst_(true),
     hiddenLast_(false),
     showThumbnails_(false),
-    thumbnailSize_(0) {
+    thumbnailSize_(0),
+    keepFirstRow_(-1),
+    keepLastRow_(-1),
+    sortJob_(nullptr),
+    sourceVersion_(0) {
 
     setDynamicSortFilter(true);
     setSortCaseSensitivity(Qt::CaseInsensitive);
 
     collator_.setNumericMode(true);
+    invalidateSortKeys();
+
+    // keep the range of the rows with thumbnails on the same items
+    connect(this, &QAbstractItemModel::rowsAboutToBeRemoved, this, &ProxyFolderModel::onRowsAboutToBeRemoved);
+    connect(this, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::onRowsRemoved);
+    connect(this, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onRowsInserted);
+    connect(this, &QAbstractItemModel::layoutAboutToBeChanged, this, &ProxyFolderModel::onLayoutAboutToBeChanged);
+    connect(this, &QAbstractItemModel::modelAboutToBeReset, this, &ProxyFolderModel::onLayoutAboutToBeChanged);
 }
 
 ProxyFolderModel::~ProxyFolderModel() {
+    cancelSortJob();
     if(showThumbnails_ && thumbnailSize_ != 0) {
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
         // tell the source model that we don't need the thumnails anymore
@@ -76,12 +293,37 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
             }
         }
     }
+    keepFirstRow_ = keepLastRow_ = -1;
+    cancelSortJob();
+    if(oldSrcModel) {
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsChanged);
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::onSourceRowsChanged);
+        disconnect(oldSrcModel, &QAbstractItemModel::layoutChanged, this, &ProxyFolderModel::onSourceRowsChanged);
+        disconnect(oldSrcModel, &QAbstractItemModel::modelReset, this, &ProxyFolderModel::onSourceRowsChanged);
+    }
+    if(model) {
+        // the rows of a background sort are outdated when these are emitted
+        connect(model, &QAbstractItemModel::rowsInserted, this, &ProxyFolderModel::onSourceRowsChanged);
+        connect(model, &QAbstractItemModel::rowsRemoved, this, &ProxyFolderModel::onSourceRowsChanged);
+        connect(model, &QAbstractItemModel::layoutChanged, this, &ProxyFolderModel::onSourceRowsChanged);
+        connect(model, &QAbstractItemModel::modelReset, this, &ProxyFolderModel::onSourceRowsChanged);
+    }
     QSortFilterProxyModel::setSourceModel(model);
 }
 
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(srcModel && column >= 0 && srcModel->rowCount() >= backgroundSortMinRows
+            && !(dynamicSortFilter() && column == sortColumn() && order == sortOrder())) { // sorted already otherwise
+        // the current order is shown until the sorted one is ready
+        startSortJob(column, order);
+        return;
+    }
+    cancelSortJob();
     int oldColumn = sortColumn();
     Qt::SortOrder oldOrder = sortOrder();
+    // make the keys of all the items in one pass before the comparisons
+    updateSortKeys(column);
     QSortFilterProxyModel::sort(column, order);
     if(column != oldColumn || order != oldOrder) {
         Q_EMIT sortFilterChanged();
@@ -123,6 +365,7 @@ void ProxyFolderModel::setHiddenLast(bool hiddenLast) {
 
 void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
     collator_.setCaseSensitivity(cs);
+    invalidateSortKeys();
     QSortFilterProxyModel::setSortCaseSensitivity(cs);
     invalidate();
     Q_EMIT sortFilterChanged();
@@ -130,9 +373,11 @@ void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
 
 bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const {
     if(!showHidden_) {
-        if(FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())) {
-            auto info = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if(info && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
+        FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+        if(srcModel && !source_parent.isValid() && source_row < srcModel->rowCount()) {
+            const quint8 hiddenFlags = backupAsHidden_ ? (FolderModel::RowIsHidden | FolderModel::RowIsBackup)
+                                                       : FolderModel::RowIsHidden;
+            if(srcModel->rowFlags(source_row) & hiddenFlags) {
                 return false;
             }
         }
@@ -152,21 +397,30 @@ bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& sourc
 bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
     FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // left and right are indexes of source model, not the proxy model.
+    if(!sortRanks_.empty()) { // the order made by a SortJob is applied
+        const int leftRank = sortRanks_[left.row()];
+        const int rightRank = sortRanks_[right.row()];
+        // the rows added after the job started are compared as usual, which gives the same order
+        if(leftRank >= 0 && rightRank >= 0) {
+            return leftRank < rightRank;
+        }
+    }
     if(srcModel) {
-        auto leftInfo = srcModel->fileInfoFromIndex(left);
-        auto rightInfo = srcModel->fileInfoFromIndex(right);
+        // only the hot fields of the rows are read, not the file infos
+        const quint8 leftFlags = srcModel->rowFlags(left.row());
+        const quint8 rightFlags = srcModel->rowFlags(right.row());
 
         if(folderFirst_) {
-            bool leftIsFolder = leftInfo->isDir();
-            bool rightIsFolder = rightInfo->isDir();
+            bool leftIsFolder = leftFlags & FolderModel::RowIsDir;
+            bool rightIsFolder = rightFlags & FolderModel::RowIsDir;
             if(leftIsFolder != rightIsFolder) {
                 return sortOrder() == Qt::AscendingOrder ? leftIsFolder : rightIsFolder;
             }
         }
 
         if(hiddenLast_) {
-            bool leftIsHidden = leftInfo->isHidden();
-            bool rightIsHidden = rightInfo->isHidden();
+            bool leftIsHidden = leftFlags & FolderModel::RowIsHidden;
+            bool rightIsHidden = rightFlags & FolderModel::RowIsHidden;
             if(leftIsHidden != rightIsHidden) {
                 return sortOrder() == Qt::AscendingOrder ? rightIsHidden : leftIsHidden;
             }
@@ -175,31 +429,228 @@ bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& righ
         int comp = 0;
         switch(sortColumn()) {
         case FolderModel::ColumnFileMTime:
-            if(leftInfo->mtime() != rightInfo->mtime()) { // quint64
-                return leftInfo->mtime() < rightInfo->mtime();
+            if(srcModel->rowMtime(left.row()) != srcModel->rowMtime(right.row())) { // quint64
+                return srcModel->rowMtime(left.row()) < srcModel->rowMtime(right.row());
             }
             break;
         case FolderModel::ColumnFileSize:
-            if(leftInfo->size() != rightInfo->size()) { // quint64
-                return leftInfo->size() < rightInfo->size();
+            if(srcModel->rowSize(left.row()) != srcModel->rowSize(right.row())) { // quint64
+                return srcModel->rowSize(left.row()) < srcModel->rowSize(right.row());
             }
             break;
         default: {
-            QString leftText = left.data(Qt::DisplayRole).toString();
-            QString rightText = right.data(Qt::DisplayRole).toString();
-            comp = collator_.compare(leftText, rightText);
+            // the texts are collated once per item, not in every comparison
+            const int keyColumn = sortKeyColumn(sortColumn());
+            comp = sortKeys(left)->columnKey(keyColumn)->compare(*sortKeys(right)->columnKey(keyColumn));
             break;
         }
         }
         // always sort files by their display names when they have the same property
         if(comp == 0) {
-            return collator_.compare(leftInfo->displayName(), rightInfo->displayName()) < 0;
+            comp = sortKeys(left)->nameKey.compare(sortKeys(right)->nameKey);
+        }
+        // the file names are unique, so that the ranks of a SortJob give the same order
+        if(comp == 0) {
+            return srcModel->itemFromIndex(left)->info->name() < srcModel->itemFromIndex(right)->info->name();
         }
         return comp < 0;
     }
     return QSortFilterProxyModel::lessThan(left, right);
 }
 
+// the collation keys of the item at srcIndex in the column of srcIndex, made once per item
+const FolderModelItem::SortKeys* ProxyFolderModel::sortKeys(const QModelIndex& srcIndex) const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    FolderModelItem* item = srcModel->itemFromIndex(srcIndex);
+    const int column = sortKeyColumn(srcIndex.column());
+    auto& keys = srcModel->rowSortKeys(srcIndex.row());
+    const bool valid = keys && keys->generation == sortKeyGeneration_;
+    if(!valid || !keys->columnKey(column)) {
+        // the keys are shared with the sort jobs, so the ones still valid are copied
+        auto newKeys = valid ? std::make_shared<FolderModelItem::SortKeys>(*keys)
+                       : std::make_shared<FolderModelItem::SortKeys>(sortKeyGeneration_, collator_.sortKey(item->displayName()));
+        newKeys->columnKeys.emplace_back(column, collator_.sortKey(srcIndex.sibling(srcIndex.row(), column).data(Qt::DisplayRole).toString()));
+        keys = std::move(newKeys);
+    }
+    return keys.get();
+}
+
+void ProxyFolderModel::startSortJob(int column, Qt::SortOrder order) {
+    cancelSortJob();
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    // take what is compared from the model, since it is only used in this thread
+    const int keyColumn = sortKeyColumn(column);
+    const int n = srcModel->rowCount();
+    std::vector<SortJob::Entry> entries(n);
+    for(int row = 0; row < n; ++row) {
+        QModelIndex srcIndex = srcModel->index(row, keyColumn);
+        auto& entry = entries[row];
+        entry.row = row;
+        entry.info = srcModel->itemFromIndex(srcIndex)->info;
+        const quint8 flags = srcModel->rowFlags(row);
+        entry.isDir = flags & FolderModel::RowIsDir;
+        entry.isHidden = flags & FolderModel::RowIsHidden;
+        entry.mtime = srcModel->rowMtime(row);
+        entry.size = srcModel->rowSize(row);
+        const auto& keys = srcModel->rowSortKeys(row);
+        if(keys && keys->generation == sortKeyGeneration_) {
+            entry.keys = keys;
+        }
+        else {
+            entry.displayName = srcModel->itemFromIndex(srcIndex)->displayName();
+        }
+        if(!entry.keys || !entry.keys->columnKey(keyColumn)) {
+            entry.text = srcIndex.data(Qt::DisplayRole).toString();
+        }
+    }
+
+    auto job = new SortJob(std::move(entries), sourceVersion_, collator_, sortKeyGeneration_, column, order, folderFirst_, hiddenLast_);
+    job->setAutoDelete(true);
+    // the entries are applied while the job waits
+    connect(job, &Job::finished, this, &ProxyFolderModel::onSortJobFinished, Qt::BlockingQueuedConnection);
+    sortJob_ = job;
+    job->runAsync();
+}
+
+void ProxyFolderModel::cancelSortJob() {
+    if(sortJob_) {
+        disconnect(sortJob_, &Job::finished, this, &ProxyFolderModel::onSortJobFinished);
+        sortJob_->cancel();
+        sortJob_ = nullptr;
+    }
+}
+
+void ProxyFolderModel::onSortJobFinished() {
+    auto job = static_cast<SortJob*>(sender());
+    if(job != sortJob_) {
+        return;
+    }
+    sortJob_ = nullptr;
+    if(job->isCancelled()) {
+        return;
+    }
+    if(job->generation() != sortKeyGeneration_
+            || job->folderFirst() != folderFirst_ || job->hiddenLast() != hiddenLast_) {
+        // sort again with the current settings
+        sort(job->column(), job->order());
+        return;
+    }
+
+    // keep the keys made by the job for the later comparisons
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    auto& entries = job->entries();
+    if(job->sourceVersion() == sourceVersion_) {
+        sortRanks_.resize(entries.size());
+        for(size_t i = 0; i < entries.size(); ++i) {
+            auto& entry = entries[i];
+            sortRanks_[entry.row] = int(i);
+            srcModel->rowSortKeys(entry.row) = std::move(entry.keys);
+        }
+    }
+    else {
+        // rows were added or removed while the folder was sorted, so find the sorted files
+        // in the current rows; the others are placed among them by the usual comparisons
+        std::unordered_map<const FileInfo*, int> ranks;
+        ranks.reserve(entries.size());
+        for(size_t i = 0; i < entries.size(); ++i) {
+            ranks.emplace(entries[i].info.get(), int(i));
+        }
+        const int n = srcModel->rowCount();
+        sortRanks_.assign(n, -1);
+        for(int row = 0; row < n; ++row) {
+            auto it = ranks.find(srcModel->itemFromIndex(srcModel->index(row, 0))->info.get());
+            if(it != ranks.end()) {
+                sortRanks_[row] = it->second;
+                srcModel->rowSortKeys(row) = std::move(entries[it->second].keys);
+            }
+        }
+    }
+
+    // with the ranks, the comparisons made by QSortFilterProxyModel are only integer ones,
+    // and the new order replaces the old one in a single layoutChanged()
+    int oldColumn = sortColumn();
+    Qt::SortOrder oldOrder = sortOrder();
+    QSortFilterProxyModel::sort(job->column(), job->order());
+    sortRanks_.clear();
+    if(job->column() != oldColumn || job->order() != oldOrder) {
+        Q_EMIT sortFilterChanged();
+    }
+}
+
+void ProxyFolderModel::onSourceRowsChanged() {
+    ++sourceVersion_;
+}
+
+// releases the thumbnails of the rows from firstRow to lastRow which are in the kept range
+void ProxyFolderModel::releaseKeptThumbnails(int firstRow, int lastRow) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || keepFirstRow_ < 0 || !showThumbnails_ || thumbnailSize_ == 0) {
+        return;
+    }
+    QModelIndexList releasedIndexes;
+    for(int row = qMax(firstRow, keepFirstRow_); row <= qMin(lastRow, keepLastRow_); ++row) {
+        releasedIndexes << mapToSource(index(row, 0));
+    }
+    if(!releasedIndexes.isEmpty()) {
+        srcModel->releaseThumbnails(releasedIndexes, thumbnailSize_);
+    }
+}
+
+void ProxyFolderModel::onRowsAboutToBeRemoved(const QModelIndex& /*parent*/, int first, int last) {
+    // the rows filtered out would keep their thumbnails otherwise
+    releaseKeptThumbnails(first, last);
+}
+
+void ProxyFolderModel::onRowsRemoved(const QModelIndex& /*parent*/, int first, int last) {
+    if(keepFirstRow_ < 0) {
+        return;
+    }
+    const int count = last - first + 1;
+    // the rows left at both ends of the range
+    keepFirstRow_ = keepFirstRow_ < first ? keepFirstRow_ : (keepFirstRow_ > last ? keepFirstRow_ - count : first);
+    keepLastRow_ = keepLastRow_ < first ? keepLastRow_ : (keepLastRow_ > last ? keepLastRow_ - count : first - 1);
+    if(keepLastRow_ < keepFirstRow_) {
+        keepFirstRow_ = keepLastRow_ = -1;
+    }
+}
+
+void ProxyFolderModel::onRowsInserted(const QModelIndex& /*parent*/, int first, int last) {
+    if(keepFirstRow_ < 0) {
+        return;
+    }
+    // the new rows inserted inside the range are kept as well
+    const int count = last - first + 1;
+    if(keepFirstRow_ >= first) {
+        keepFirstRow_ += count;
+    }
+    if(keepLastRow_ >= first) {
+        keepLastRow_ += count;
+    }
+}
+
+void ProxyFolderModel::onLayoutAboutToBeChanged() {
+    // the kept items are scattered by a sort or a filter change; the thumbnails of the ones
+    // still shown are found in the thumbnail cache when they are painted
+    releaseKeptThumbnails(keepFirstRow_, keepLastRow_);
+    keepFirstRow_ = keepLastRow_ = -1;
+}
+
+void ProxyFolderModel::updateSortKeys(int column) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || column < 0) {
+        return;
+    }
+    int n = srcModel->rowCount();
+    for(int row = 0; row < n; ++row) {
+        sortKeys(srcModel->index(row, column));
+    }
+}
+
+// called when the collator settings change
+void ProxyFolderModel::invalidateSortKeys() {
+    sortKeyGeneration_ = sortKeyGeneration(collator_);
+}
+
 std::shared_ptr<const Fm::FileInfo> ProxyFolderModel::fileInfoFromIndex(const QModelIndex& index) const {
     if(index.isValid()) {
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
@@ -232,6 +683,7 @@ std::shared_ptr<const FileInfo> ProxyFolderModel::fileInfoFromPath(const FilePat
 void ProxyFolderModel::setShowThumbnails(bool show) {
     if(show != showThumbnails_) {
         showThumbnails_ = show;
+        keepFirstRow_ = keepLastRow_ = -1;
         FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
         if(srcModel && thumbnailSize_ != 0) {
             if(show) {
@@ -270,7 +722,86 @@ void ProxyFolderModel::setThumbnailSize(int size) {
         }
 
         thumbnailSize_ = size;
+        keepFirstRow_ = keepLastRow_ = -1;
+    }
+}
+
+void ProxyFolderModel::setVisibleRows(int firstRow, int lastRow, int scrollVelocity) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if(!srcModel || !showThumbnails_ || thumbnailSize_ == 0) {
+        return;
+    }
+    int n = rowCount();
+    firstRow = qMax(firstRow, 0);
+    lastRow = qMin(lastRow, n - 1);
+    if(firstRow > lastRow) {
+        return;
+    }
+    const int pageRows = lastRow - firstRow + 1;
+
+    // the thumbnails kept besides the visible ones are bounded by the memory of the shared
+    // thumbnail cache, which holds them anyway, but at least two pages are kept
+    const size_t thumbnailCost = size_t(thumbnailSize_) * thumbnailSize_ * 4;
+    const int budgetRows = int(qMin(ThumbnailCache::globalInstance()->maxSize() / thumbnailCost, size_t(n)));
+    const int spareRows = qMax(budgetRows - pageRows, 2 * pageRows);
+
+    // prefetch about what is scrolled into view in half a second, and at least a page, ahead;
+    // when the view is not scrolled, half of the spare rows on both sides
+    int aheadRows, behindRows;
+    if(scrollVelocity == 0) {
+        aheadRows = behindRows = qMin(pageRows, spareRows / 2);
+    }
+    else {
+        aheadRows = qMin(qMax(pageRows, qAbs(scrollVelocity) / 2), spareRows * 3 / 4);
+        behindRows = 0;
+    }
+    const bool scrollingUp = scrollVelocity < 0;
+
+    QModelIndexList visibleIndexes;
+    for(int row = firstRow; row <= lastRow; ++row) {
+        visibleIndexes << mapToSource(index(row, 0));
+    }
+    QModelIndexList prefetchIndexes;
+    // the rows closest to the visible ones come first
+    auto prefetch = [&](int rowCount, bool up) {
+        if(up) {
+            for(int row = firstRow - 1; row >= qMax(firstRow - rowCount, 0); --row) {
+                prefetchIndexes << mapToSource(index(row, 0));
+            }
+        }
+        else {
+            for(int row = lastRow + 1; row < qMin(lastRow + 1 + rowCount, n); ++row) {
+                prefetchIndexes << mapToSource(index(row, 0));
+            }
+        }
+    };
+    prefetch(aheadRows, scrollingUp);
+    prefetch(behindRows, !scrollingUp);
+    srcModel->setThumbnailPriorities(visibleIndexes, prefetchIndexes);
+
+    // keep the prefetched rows, and behind the visible ones what is left of the budget
+    const int keepBehindRows = qMax(spareRows - aheadRows, behindRows);
+    int keepFirstRow = qMax(firstRow - (scrollingUp ? aheadRows : keepBehindRows), 0);
+    int keepLastRow = qMin(lastRow + (scrollingUp ? keepBehindRows : aheadRows), n - 1);
+
+    // release the thumbnails of the rows which are not kept anymore; the ones outside of the
+    // previous range are released already, so only the rows left since then are visited
+    if(keepFirstRow_ >= 0) {
+        QModelIndexList releasedIndexes;
+        for(int row = keepFirstRow_; row <= qMin(keepLastRow_, n - 1); ++row) {
+            if(row < keepFirstRow || row > keepLastRow) {
+                releasedIndexes << mapToSource(index(row, 0));
+            }
+            else { // skip the rows kept
+                row = keepLastRow;
+            }
+        }
+        if(!releasedIndexes.isEmpty()) {
+            srcModel->releaseThumbnails(releasedIndexes, thumbnailSize_);
+        }
     }
+    keepFirstRow_ = keepFirstRow;
+    keepLastRow_ = keepLastRow;
 }
 
 QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
@@ -279,9 +810,9 @@ QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
             // we need to show thumbnails instead of icons
             FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
             QModelIndex srcIndex = mapToSource(index);
-            QImage image = srcModel->thumbnailFromIndex(srcIndex, thumbnailSize_);
-            if(!image.isNull()) { // if we got a thumbnail of the desired size, use it
-                return QVariant(image);
+            QPixmap pixmap = srcModel->thumbnailPixmapFromIndex(srcIndex, thumbnailSize_);
+            if(!pixmap.isNull()) { // if we got a thumbnail of the desired size, use it
+                return QVariant(pixmap);
             }
         }
     }
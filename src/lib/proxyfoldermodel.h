@@ -25,8 +25,11 @@
 #include <QSortFilterProxyModel>
 #include <QList>
 #include <QCollator>
+#include <vector>
 
 #include "core/fileinfo.h"
+#include "core/job.h"
+#include "foldermodelitem.h"
 
 namespace Fm {
 
@@ -83,6 +86,11 @@ public:
     }
     void setThumbnailSize(int size);
 
+    // called by views to load the thumbnails of the given rows first, and then the ones of
+    // the rows the view is scrolled to; scrollVelocity is in rows per second, negative upwards.
+    // the thumbnails of the rows left far behind are released.
+    void setVisibleRows(int firstRow, int lastRow, int scrollVelocity);
+
     std::shared_ptr<const Fm::FileInfo> fileInfoFromIndex(const QModelIndex& index) const;
 
     std::shared_ptr<const Fm::FileInfo> fileInfoFromPath(const FilePath& path) const;
@@ -102,20 +110,49 @@ Q_SIGNALS:
 protected Q_SLOTS:
     void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
 
+private Q_SLOTS:
+    void onSortJobFinished();
+    void onSourceRowsChanged();
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    void onRowsRemoved(const QModelIndex& parent, int first, int last);
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onLayoutAboutToBeChanged();
+
 protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const override;
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const override;
     // void reloadAllThumbnails();
 
+private:
+    const FolderModelItem::SortKeys* sortKeys(const QModelIndex& srcIndex) const;
+    void updateSortKeys(int column);
+    void invalidateSortKeys();
+    void startSortJob(int column, Qt::SortOrder order);
+    void cancelSortJob();
+    void releaseKeptThumbnails(int firstRow, int lastRow);
+
 private:
     QCollator collator_;
+    // the sort keys cached in the items are made with the current collator settings if they have this
+    quint64 sortKeyGeneration_;
     bool showHidden_;
     bool backupAsHidden_;
     bool folderFirst_;
     bool hiddenLast_;
     bool showThumbnails_;
     int thumbnailSize_;
+    // the rows whose thumbnails are kept, as of the last setVisibleRows(); moved along when rows
+    // are inserted or removed, and forgotten with their thumbnails when the rows are reordered
+    int keepFirstRow_;
+    int keepLastRow_;
     QList<ProxyFolderModelFilter*> filters_;
+    // sorts large folders in other threads
+    Job* sortJob_;
+    // changed when rows are added to or removed from the source model
+    quint64 sourceVersion_;
+    // the rank of each source row in the order made by sortJob_, while it is applied;
+    // -1 for the rows added after the job started
+    std::vector<int> sortRanks_;
 };
 
 }
@@ -197,6 +197,7 @@ bool Settings::loadFile(QString filePath)
     confirmTrash_ = settings.value(QStringLiteral("ConfirmTrash"), false).toBool();
     setQuickExec(settings.value(QStringLiteral("QuickExec"), false).toBool());
     selectNewFiles_ = settings.value(QStringLiteral("SelectNewFiles"), false).toBool();
+    setCopyWorkerCount(settings.value(QStringLiteral("CopyWorkerCount"), 1).toInt());
     // bool thumbnailLocal_;
     // bool thumbnailMax;
     settings.endGroup();
@@ -243,6 +244,11 @@ bool Settings::loadFile(QString filePath)
     showThumbnails_ = settings.value(QStringLiteral("ShowThumbnails"), true).toBool();
     setMaxThumbnailFileSize(settings.value(QStringLiteral("MaxThumbnailFileSize"), 4096).toInt());
     setThumbnailLocalFilesOnly(settings.value(QStringLiteral("ThumbnailLocalFilesOnly"), true).toBool());
+    setThumbnailWorkerCount(settings.value(QStringLiteral("ThumbnailWorkerCount"), 0).toInt());
+    setThumbnailCacheSize(settings.value(QStringLiteral("ThumbnailCacheSize"), 32).toInt());
+    setThumbnailPacks(settings.value(QStringLiteral("ThumbnailPacks"), false).toBool());
+    setThumbnailerProcesses(settings.value(QStringLiteral("ThumbnailerProcesses"), 2).toInt());
+    setThumbnailerTimeout(settings.value(QStringLiteral("ThumbnailerTimeout"), 20).toInt());
     settings.endGroup();
 
     settings.beginGroup(QStringLiteral("FolderView"));
@@ -339,6 +345,7 @@ bool Settings::saveFile(QString filePath)
     settings.setValue(QStringLiteral("ConfirmTrash"), confirmTrash_);
     settings.setValue(QStringLiteral("QuickExec"), quickExec_);
     settings.setValue(QStringLiteral("SelectNewFiles"), selectNewFiles_);
+    settings.setValue(QStringLiteral("CopyWorkerCount"), copyWorkerCount());
     // bool thumbnailLocal_;
     // bool thumbnailMax;
     settings.endGroup();
@@ -377,6 +384,11 @@ bool Settings::saveFile(QString filePath)
     settings.setValue(QStringLiteral("ShowThumbnails"), showThumbnails_);
     settings.setValue(QStringLiteral("MaxThumbnailFileSize"), maxThumbnailFileSize());
     settings.setValue(QStringLiteral("ThumbnailLocalFilesOnly"), thumbnailLocalFilesOnly());
+    settings.setValue(QStringLiteral("ThumbnailWorkerCount"), thumbnailWorkerCount());
+    settings.setValue(QStringLiteral("ThumbnailCacheSize"), thumbnailCacheSize());
+    settings.setValue(QStringLiteral("ThumbnailPacks"), thumbnailPacks());
+    settings.setValue(QStringLiteral("ThumbnailerProcesses"), thumbnailerProcesses());
+    settings.setValue(QStringLiteral("ThumbnailerTimeout"), thumbnailerTimeout());
     settings.endGroup();
 
     settings.beginGroup(QStringLiteral("FolderView"));
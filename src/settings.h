@@ -8,6 +8,9 @@
 #include "lib/foldermodel.h"
 #include "lib/sidepane.h"
 #include "lib/core/thumbnailjob.h"
+#include "lib/core/thumbnailcache.h"
+#include "lib/core/thumbnailer.h"
+#include "lib/core/filetransferjob.h"
 #include "lib/core/archiver.h"
 #include "lib/core/legacy/fm-config.h"
 
@@ -672,6 +675,15 @@ public:
         selectNewFiles_ = value;
     }
 
+    // number of files copied in parallel (1 = one by one, 0 = chosen per filesystem)
+    int copyWorkerCount() const {
+        return Fm::FileTransferJob::defaultWorkerCount();
+    }
+
+    void setCopyWorkerCount(int count) {
+        Fm::FileTransferJob::setDefaultWorkerCount(qMax(count, 0));
+    }
+
     // bool thumbnailLocal_;
     // bool thumbnailMax;
 
@@ -744,6 +756,49 @@ public:
         Fm::ThumbnailJob::setMaxThumbnailFileSize(size);
     }
 
+    // 0 means automatic
+    int thumbnailWorkerCount() const {
+        return Fm::ThumbnailJob::workerCount();
+    }
+
+    void setThumbnailWorkerCount(int count) {
+        Fm::ThumbnailJob::setWorkerCount(count);
+    }
+
+    int thumbnailerProcesses() const {
+        return Fm::Thumbnailer::maxProcesses();
+    }
+
+    void setThumbnailerProcesses(int count) {
+        Fm::Thumbnailer::setMaxProcesses(count);
+    }
+
+    // in seconds
+    int thumbnailerTimeout() const {
+        return Fm::Thumbnailer::timeout();
+    }
+
+    void setThumbnailerTimeout(int seconds) {
+        Fm::Thumbnailer::setTimeout(seconds);
+    }
+
+    bool thumbnailPacks() const {
+        return Fm::ThumbnailJob::useThumbnailPacks();
+    }
+
+    void setThumbnailPacks(bool value) {
+        Fm::ThumbnailJob::setUseThumbnailPacks(value);
+    }
+
+    // in MiB
+    int thumbnailCacheSize() const {
+        return static_cast<int>(Fm::ThumbnailCache::globalInstance()->maxSize() / (1024 * 1024));
+    }
+
+    void setThumbnailCacheSize(int size) {
+        Fm::ThumbnailCache::globalInstance()->setMaxSize(size_t(qMax(size, 0)) * 1024 * 1024);
+    }
+
     void setThumbnailIconSize(int thumbnailIconSize) {
         thumbnailIconSize_ = thumbnailIconSize;
     }